@@ -0,0 +1,91 @@
+// Bulk load and query throughput of a Library whose tables allocate from the
+// default heap, from a std::pmr::unsynchronized_pool_resource and from a
+// std::pmr::monotonic_buffer_resource, plus get_books_by_author with its
+// result in a std::vector or in a reused scratch arena.
+//
+// Book strings live in the process-wide string pool, so an untimed load runs
+// first to intern them all; the timed loads then measure the tables alone.
+//
+// Usage: arena_allocation [books] [queries]
+#include "library.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using DayLibrary = Library<std::chrono::hours>;
+
+struct BookSpec {
+    std::string name, author, genre;
+};
+
+static void load(DayLibrary& library, const std::vector<BookSpec>& specs) {
+    for (size_t id = 0; id < specs.size(); ++id) {
+        library.add_book(Book(specs[id].name, specs[id].author, specs[id].genre, static_cast<int>(id)));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int books = argc > 1 ? std::atoi(argv[1]) : 500000;
+    int queries = argc > 2 ? std::atoi(argv[2]) : 200000;
+    if (books <= 0 || queries <= 0) {
+        std::fprintf(stderr, "usage: %s [books] [queries]\n", argv[0]);
+        return 2;
+    }
+    std::mt19937 random(7);
+    int authors = books / 20 + 1;
+    std::vector<BookSpec> specs(static_cast<size_t>(books));
+    for (auto& spec : specs) {
+        spec.name = "Title " + std::to_string(random() % static_cast<unsigned>(books / 2 + 1)) + " of the Series";
+        spec.author = "Author " + std::to_string(random() % static_cast<unsigned>(authors));
+        spec.genre = "Genre " + std::to_string(random() % 100);
+    }
+    std::vector<std::string> query_authors(static_cast<size_t>(queries));
+    for (auto& author : query_authors) {
+        author = "Author " + std::to_string(random() % static_cast<unsigned>(authors));
+    }
+    {
+        DayLibrary warm_up(std::chrono::hours(24));
+        load(warm_up, specs);
+    }
+
+    auto default_library = std::make_unique<DayLibrary>(std::chrono::hours(24));
+    double default_load = seconds_of([&] { load(*default_library, specs); });
+
+    std::pmr::unsynchronized_pool_resource pool;
+    auto pool_library = std::make_unique<DayLibrary>(std::chrono::hours(24), &pool);
+    double pool_load = seconds_of([&] { load(*pool_library, specs); });
+
+    std::pmr::monotonic_buffer_resource arena;
+    auto arena_library = std::make_unique<DayLibrary>(std::chrono::hours(24), &arena);
+    double arena_load = seconds_of([&] { load(*arena_library, specs); });
+
+    long long checksum = 0;
+    double vector_queries = seconds_of([&] {
+        for (const auto& author : query_authors) {
+            checksum += static_cast<long long>(default_library->get_books_by_author(author).size());
+        }
+    });
+    std::byte buffer[64 * 1024];
+    double scratch_queries = seconds_of([&] {
+        std::pmr::monotonic_buffer_resource scratch(buffer, sizeof(buffer));
+        for (const auto& author : query_authors) {
+            checksum -= static_cast<long long>(default_library->get_books_by_author(author, &scratch).size());
+            scratch.release();
+        }
+    });
+
+    std::printf("{\"bench\":\"arena_allocation\",\"books\":%d,\"queries\":%d,"
+                "\"load_s\":{\"default\":%.3f,\"pool\":%.3f,\"monotonic\":%.3f},"
+                "\"queries_per_s\":{\"vector\":%.0f,\"scratch_arena\":%.0f},\"checksum\":%lld}\n",
+                books, queries, default_load, pool_load, arena_load,
+                queries / vector_queries, queries / scratch_queries, checksum);
+    return checksum == 0 ? 0 : 1;
+}
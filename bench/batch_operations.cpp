@@ -0,0 +1,98 @@
+// Compares borrow_books/return_books with the same work done through
+// borrow_book/return_book in a loop. Every eighth request asks for a book
+// that is already out, as happens at a busy kiosk.
+//
+// Usage: batch_operations [books] [batch_size]
+#include "library.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+using DayLibrary = Library<std::chrono::hours>;
+
+static std::unique_ptr<DayLibrary> make_library(int books) {
+    auto library = std::make_unique<DayLibrary>(std::chrono::hours(24));
+    for (int book_id = 0; book_id < books; ++book_id) {
+        library->add_book(Book("Title", "Author", "Genre", book_id));
+    }
+    // Ten books per user stays within the faculty limit.
+    for (int user = 0; user < books / 10 + 1; ++user) {
+        library->add_user(make_user(UserType::FACULTY, "Patron", "patron@example.com", books + user));
+    }
+    return library;
+}
+
+static std::vector<std::pair<int, int>> make_loans(int books) {
+    std::vector<std::pair<int, int>> loans;
+    for (int book_id = 0; book_id < books; ++book_id) {
+        loans.emplace_back(books + book_id / 10, book_id);
+        if (book_id % 8 == 7) {
+            loans.emplace_back(books + book_id / 10, book_id - 1);
+        }
+    }
+    return loans;
+}
+
+int main(int argc, char* argv[]) {
+    int books = argc > 1 ? std::atoi(argv[1]) : 200000;
+    size_t batch_size = argc > 2 ? static_cast<size_t>(std::atoi(argv[2])) : 64;
+    if (books <= 0 || batch_size == 0) {
+        std::fprintf(stderr, "usage: %s [books] [batch_size]\n", argv[0]);
+        return 2;
+    }
+    auto loans = make_loans(books);
+
+    auto single = make_library(books);
+    long long single_failures = 0;
+    double single_borrow = seconds_of([&] {
+        for (const auto& [user_id, book_id] : loans) {
+            try {
+                single->borrow_book(user_id, book_id);
+            } catch (const LibraryOperationException&) {
+                ++single_failures;
+            }
+        }
+    });
+    double single_return = seconds_of([&] {
+        for (int book_id = 0; book_id < books; ++book_id) {
+            single->return_book(book_id);
+        }
+    });
+
+    auto batched = make_library(books);
+    long long batch_failures = 0;
+    double batch_borrow = seconds_of([&] {
+        for (size_t first = 0; first < loans.size(); first += batch_size) {
+            std::vector<std::pair<int, int>> batch(loans.begin() + first,
+                                                   loans.begin() + std::min(loans.size(), first + batch_size));
+            for (LibraryError error : batched->borrow_books(batch)) {
+                batch_failures += error != LibraryError::NONE;
+            }
+        }
+    });
+    double batch_return = seconds_of([&] {
+        std::vector<int> batch;
+        for (int book_id = 0; book_id < books; ++book_id) {
+            batch.push_back(book_id);
+            if (batch.size() == batch_size || book_id + 1 == books) {
+                batched->return_books(batch);
+                batch.clear();
+            }
+        }
+    });
+
+    bool consistent = single_failures == batch_failures
+        && single->borrow_history_size() == batched->borrow_history_size()
+        && batched->get_borrowed_books().empty();
+    std::printf("{\"bench\":\"batch_operations\",\"books\":%d,\"batch_size\":%zu,"
+                "\"single_borrow_sec\":%.4f,\"batch_borrow_sec\":%.4f,"
+                "\"single_return_sec\":%.4f,\"batch_return_sec\":%.4f,\"consistent\":%s}\n",
+                books, batch_size, single_borrow, batch_borrow, single_return, batch_return,
+                consistent ? "true" : "false");
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+#pragma once
+// Measurement helpers shared by the benchmarks.
+#include <chrono>
+#if defined(__GLIBC__)
+    #include <malloc.h>
+#endif
+#ifndef _WIN32
+    #include <sys/resource.h>
+#endif
+
+
+template <typename F>
+inline double seconds_of(F&& body) {
+    auto started = std::chrono::steady_clock::now();
+    body();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+}
+
+// Bytes the process has allocated and not freed, from glibc's allocator
+// statistics, so it includes the allocator's own per-block overhead.
+inline double heap_bytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return static_cast<double>(mallinfo2().uordblks);
+#else
+    return 0; // not measured on this platform
+#endif
+}
+
+inline double peak_rss_mb() {
+#ifndef _WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    #ifdef __APPLE__
+    return static_cast<double>(usage.ru_maxrss) / 1e6; // bytes
+    #else
+    return static_cast<double>(usage.ru_maxrss) / 1e3; // kilobytes
+    #endif
+#else
+    return 0; // not measured on this platform
+#endif
+}
@@ -0,0 +1,84 @@
+// Contention benchmark for the borrow path: N threads keep borrowing and
+// returning books from a small hot set, so most attempts collide with another
+// desk. Every successful borrow checks that nobody else holds the same book,
+// which catches a lost update of the owner.
+//
+// Usage: borrow_contention [threads] [hot_books] [attempts_per_thread]
+#include "library.h"
+#include "bench_util.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+int main(int argc, char* argv[]) {
+    int threads = argc > 1 ? std::atoi(argv[1]) : static_cast<int>(std::thread::hardware_concurrency());
+    int hot_books = argc > 2 ? std::atoi(argv[2]) : 8;
+    int attempts = argc > 3 ? std::atoi(argv[3]) : 200000;
+    if (threads <= 0 || hot_books <= 0 || attempts <= 0) {
+        std::fprintf(stderr, "usage: %s [threads] [hot_books] [attempts_per_thread]\n", argv[0]);
+        return 2;
+    }
+
+    Library<std::chrono::hours> library(std::chrono::hours(24));
+    for (int book_id = 0; book_id < hot_books; ++book_id) {
+        library.add_book(Book("Hot title", "Author", "Genre", book_id));
+    }
+    // One patron per desk; each loan is returned right away.
+    for (int thread = 0; thread < threads; ++thread) {
+        library.add_user(make_user(UserType::FACULTY, "Desk", "desk@example.com", hot_books + thread));
+    }
+
+    std::vector<std::atomic<int>> holders(hot_books);
+    std::atomic<long long> borrowed{0}, conflicts{0}, lost_updates{0};
+    std::atomic<bool> start{false};
+
+    std::vector<std::thread> workers;
+    for (int thread = 0; thread < threads; ++thread) {
+        workers.emplace_back([&, thread] {
+            std::mt19937 random(thread);
+            const int user_id = hot_books + thread;
+            long long thread_borrowed = 0, thread_conflicts = 0;
+            while (!start.load()) {
+                std::this_thread::yield();
+            }
+            for (int attempt = 0; attempt < attempts; ++attempt) {
+                int book_id = static_cast<int>(random() % hot_books);
+                if (library.try_borrow_book(user_id, book_id) != LibraryError::NONE) {
+                    ++thread_conflicts;
+                    continue;
+                }
+                if (holders[book_id].fetch_add(1) != 0) {
+                    ++lost_updates;
+                }
+                holders[book_id].fetch_sub(1);
+                library.try_return_book(book_id);
+                ++thread_borrowed;
+            }
+            borrowed += thread_borrowed;
+            conflicts += thread_conflicts;
+        });
+    }
+
+    double seconds = seconds_of([&] {
+        start = true;
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    });
+
+    long long operations = static_cast<long long>(threads) * attempts;
+    bool consistent = lost_updates == 0
+        && library.get_borrowed_books().empty()
+        && library.borrow_history_size() == static_cast<size_t>(2 * borrowed);
+    std::printf("{\"bench\":\"borrow_contention\",\"threads\":%d,\"hot_books\":%d,\"attempts\":%lld,"
+                "\"seconds\":%.3f,\"attempts_per_sec\":%.0f,\"borrowed\":%lld,\"conflicts\":%lld,"
+                "\"lost_updates\":%lld,\"consistent\":%s}\n",
+                threads, hot_books, operations, seconds, operations / seconds,
+                borrowed.load(), conflicts.load(), lost_updates.load(), consistent ? "true" : "false");
+    return consistent ? 0 : 1;
+}
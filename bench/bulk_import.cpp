@@ -0,0 +1,81 @@
+// Loads a generated CSV catalog with import_books() and, for comparison,
+// with one add_book() call per line after a plain std::getline/split parse.
+// Reports books per second and the heap each library ends up holding, read
+// from glibc's allocator statistics as in user_storage. The two loads use
+// different titles, so neither finds the other's strings already interned.
+//
+// Usage: bulk_import [books] [threads]
+#include "bulk_import.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+
+
+using DayLibrary = Library<std::chrono::hours>;
+
+static void write_catalog(const std::string& path, int books, const char* title) {
+    std::mt19937 random(11);
+    std::ofstream out(path);
+    out << "id,name,author,genre\n";
+    for (int id = 0; id < books; ++id) {
+        out << id << ",\"" << title << ' ' << id << ", Vol. " << random() % 9 + 1 << "\",Author "
+            << random() % static_cast<unsigned>(books / 20 + 1) << ",Genre " << random() % 100 << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int books = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    unsigned threads = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2])) : 0;
+    if (books <= 0) {
+        std::fprintf(stderr, "usage: %s [books] [threads]\n", argv[0]);
+        return 2;
+    }
+    auto directory = std::filesystem::temp_directory_path();
+    std::string bulk_path = (directory / "bulk_import_bench_a.csv").string();
+    std::string loop_path = (directory / "bulk_import_bench_b.csv").string();
+    write_catalog(bulk_path, books, "Chronicle");
+    write_catalog(loop_path, books, "Saga");
+
+    double before = heap_bytes();
+    DayLibrary bulk(std::chrono::hours(24));
+    ImportOptions options;
+    options.threads = threads;
+    ImportStats stats;
+    double bulk_s = seconds_of([&] { stats = import_books(bulk, bulk_path, options); });
+    double bulk_bytes = heap_bytes() - before;
+
+    before = heap_bytes();
+    DayLibrary loop(std::chrono::hours(24));
+    double loop_s = seconds_of([&] {
+        std::ifstream in(loop_path);
+        std::string line, id, name, rest, author, genre;
+        std::getline(in, line);
+        while (std::getline(in, line)) {
+            // Every generated title is quoted and contains one comma.
+            std::istringstream fields(line);
+            std::getline(fields, id, ',');
+            std::getline(fields, name, ',');
+            std::getline(fields, rest, ',');
+            std::getline(fields, author, ',');
+            std::getline(fields, genre);
+            loop.add_book(Book(name.substr(1) + "," + rest.substr(0, rest.size() - 1), author, genre, std::stoi(id)));
+        }
+    });
+    double loop_bytes = heap_bytes() - before;
+
+    std::filesystem::remove(bulk_path);
+    std::filesystem::remove(loop_path);
+    bool consistent = stats.imported == static_cast<size_t>(books) && loop.book_count() == bulk.book_count();
+    std::printf("{\"bench\":\"bulk_import\",\"books\":%d,\"threads\":%u,"
+                "\"import_books\":{\"books_per_s\":%.0f,\"heap_mb\":%.1f},"
+                "\"add_book_loop\":{\"books_per_s\":%.0f,\"heap_mb\":%.1f},\"consistent\":%s}\n",
+                books, threads, books / bulk_s, bulk_bytes / 1e6, books / loop_s, loop_bytes / 1e6,
+                consistent ? "true" : "false");
+    return consistent ? 0 : 1;
+}
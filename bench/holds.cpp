@@ -0,0 +1,63 @@
+// Hold queues at scale: every book is out, and patrons queue for them until
+// there are `holds` holds in total. Measures place_hold, then the returns that
+// hand each book to its next holder, and prints one JSON object with ns per
+// call and the RSS the holds added.
+//
+// Usage: holds [holds] [books] [patrons]
+#include "library.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+
+int main(int argc, char* argv[]) {
+    int holds = argc > 1 ? std::atoi(argv[1]) : 2000000;
+    int books = argc > 2 ? std::atoi(argv[2]) : 200000;
+    int patrons = argc > 3 ? std::atoi(argv[3]) : 500000;
+    if (holds <= 0 || books <= 0 || patrons <= 0) {
+        std::fprintf(stderr, "usage: %s [holds] [books] [patrons]\n", argv[0]);
+        return 2;
+    }
+    // Faculty patrons: the highest borrow limit, and holds that outlive the run.
+    Library<std::chrono::hours> library(std::chrono::hours(24));
+    for (int id = 0; id < books; ++id) {
+        library.add_book(Book("Title", "Author", "Genre", id));
+    }
+    for (int i = 0; i < patrons; ++i) {
+        library.add_user(Faculty("Patron", "patron@example.org", books + i));
+    }
+    for (int id = 0; id < books; ++id) {
+        library.borrow_book(books + id % patrons, id);
+    }
+
+    std::mt19937 random(5);
+    std::vector<std::pair<int, int>> requests(static_cast<size_t>(holds)); // (user_id, book_id)
+    for (auto& [user_id, book_id] : requests) {
+        user_id = books + static_cast<int>(random() % static_cast<unsigned>(patrons));
+        book_id = static_cast<int>(random() % static_cast<unsigned>(books));
+    }
+    double rss_before = peak_rss_mb();
+    size_t placed = 0;
+    double place_s = seconds_of([&] {
+        for (const auto& [user_id, book_id] : requests) {
+            placed += library.try_place_hold(user_id, book_id) == LibraryError::NONE;
+        }
+    });
+    double rss_after = peak_rss_mb();
+
+    size_t handed_off = 0;
+    library.subscribe([&](const AvailabilityEvent& event) { handed_off += event.user_id != BookStore::kNoOwner; });
+    double return_s = seconds_of([&] {
+        for (int id = 0; id < books; ++id) {
+            library.return_book(id);
+        }
+    });
+
+    std::printf("{\"bench\":\"holds\",\"holds\":%zu,\"books\":%d,\"patrons\":%d,"
+                "\"ns_per_call\":{\"place_hold\":%.0f,\"return_book_with_handoff\":%.0f},"
+                "\"handed_off\":%zu,\"rss_mb_for_holds\":%.1f}\n",
+                placed, books, patrons, place_s * 1e9 / holds, return_s * 1e9 / books, handed_off, rss_after - rss_before);
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Single-threaded microbenchmarks of the Library calls a desk makes most:
+// add_book, borrow_book, return_book, get_books_by_{name,author,genre},
+// get_borrowed_books and get_overdue_books. Prints one JSON object with the
+// mean nanoseconds per call of each, so runs can be diffed by a script.
+//
+// The library holds `books` books by books / 20 authors in 100 genres, and
+// faculty patrons borrow eight books each. For get_overdue_books a second
+// library runs on virtual time, moved past every due date after the loans.
+//
+// Usage: library_ops [books] [queries]
+#include "library.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+
+static double ns_per(double seconds, size_t calls) {
+    return seconds * 1e9 / static_cast<double>(calls);
+}
+
+struct Catalog {
+    std::vector<std::string> names, authors, genres;
+};
+
+template <typename Duration>
+static void add_books(Library<Duration>& library, const Catalog& catalog) {
+    for (size_t id = 0; id < catalog.names.size(); ++id) {
+        library.add_book(Book(catalog.names[id], catalog.authors[id], catalog.genres[id], static_cast<int>(id)));
+    }
+}
+
+template <typename Duration>
+static void add_patrons(Library<Duration>& library, const Catalog& catalog, int patrons) {
+    for (int i = 0; i < patrons; ++i) {
+        library.add_user(Faculty("Patron", "patron@example.org", static_cast<int>(catalog.names.size()) + i));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int books = argc > 1 ? std::atoi(argv[1]) : 200000;
+    int queries = argc > 2 ? std::atoi(argv[2]) : 100000;
+    if (books <= 0 || queries <= 0) {
+        std::fprintf(stderr, "usage: %s [books] [queries]\n", argv[0]);
+        return 2;
+    }
+    std::mt19937 random(3);
+    Catalog catalog;
+    for (int id = 0; id < books; ++id) {
+        catalog.names.push_back("Title " + std::to_string(random() % static_cast<unsigned>(books / 2 + 1)));
+        catalog.authors.push_back("Author " + std::to_string(random() % static_cast<unsigned>(books / 20 + 1)));
+        catalog.genres.push_back("Genre " + std::to_string(random() % 100));
+    }
+    constexpr int kLoansPerPatron = 8;
+    int patrons = books / kLoansPerPatron + 1;
+    auto patron_of = [&](int book_id) { return books + book_id / kLoansPerPatron; };
+    std::vector<int> query_ids(static_cast<size_t>(queries));
+    for (int& id : query_ids) {
+        id = static_cast<int>(random() % static_cast<unsigned>(books));
+    }
+    long long checksum = 0;
+
+    Library<std::chrono::hours> library(std::chrono::hours(24));
+    double add_book_s = seconds_of([&] { add_books(library, catalog); });
+    add_patrons(library, catalog, patrons);
+
+    double borrow_s = seconds_of([&] {
+        for (int book_id = 0; book_id < books; ++book_id) {
+            library.borrow_book(patron_of(book_id), book_id);
+        }
+    });
+    std::set<Book> borrowed;
+    int borrowed_reads = std::max(1, queries / books);
+    double borrowed_s = seconds_of([&] {
+        for (int i = 0; i < borrowed_reads; ++i) {
+            borrowed = library.get_borrowed_books();
+            checksum += static_cast<long long>(borrowed.size());
+        }
+    });
+    double return_s = seconds_of([&] {
+        for (int book_id = 0; book_id < books; ++book_id) {
+            checksum += library.return_book(book_id);
+        }
+    });
+
+    auto query = [&](auto get) {
+        return seconds_of([&] {
+            for (int id : query_ids) {
+                checksum += static_cast<long long>(get(static_cast<size_t>(id)).size());
+            }
+        });
+    };
+    double by_name_s = query([&](size_t id) { return library.get_books_by_name(catalog.names[id]); });
+    double by_author_s = query([&](size_t id) { return library.get_books_by_author(catalog.authors[id]); });
+    double by_genre_s = query([&](size_t id) { return library.get_books_by_genre(catalog.genres[id]); });
+
+    VirtualTimeSource time(std::chrono::system_clock::now());
+    Library<std::chrono::hours> late(std::chrono::hours(24));
+    late.set_time_source(&time);
+    add_books(late, catalog);
+    add_patrons(late, catalog, patrons);
+    for (int book_id = 0; book_id < books; ++book_id) {
+        late.borrow_book(patron_of(book_id), book_id);
+    }
+    time.advance(std::chrono::hours(24 * 365));
+    std::set<Book> overdue;
+    double overdue_s = seconds_of([&] {
+        for (int i = 0; i < borrowed_reads; ++i) {
+            overdue = late.get_overdue_books();
+            checksum += static_cast<long long>(overdue.size());
+        }
+    });
+
+    std::printf("{\"bench\":\"library_ops\",\"books\":%d,\"queries\":%d,\"ns_per_call\":{"
+                "\"add_book\":%.0f,\"borrow_book\":%.0f,\"return_book\":%.0f,"
+                "\"get_books_by_name\":%.0f,\"get_books_by_author\":%.0f,\"get_books_by_genre\":%.0f,"
+                "\"get_borrowed_books\":%.0f,\"get_overdue_books\":%.0f},"
+                "\"ns_per_listed_book\":{\"get_borrowed_books\":%.1f,\"get_overdue_books\":%.1f},\"checksum\":%lld}\n",
+                books, queries, ns_per(add_book_s, books), ns_per(borrow_s, books), ns_per(return_s, books),
+                ns_per(by_name_s, query_ids.size()), ns_per(by_author_s, query_ids.size()), ns_per(by_genre_s, query_ids.size()),
+                ns_per(borrowed_s, borrowed_reads), ns_per(overdue_s, borrowed_reads),
+                ns_per(borrowed_s, static_cast<size_t>(borrowed_reads) * borrowed.size()),
+                ns_per(overdue_s, static_cast<size_t>(borrowed_reads) * std::max<size_t>(overdue.size(), 1)), checksum);
+    return borrowed.size() == static_cast<size_t>(books) && overdue.size() == static_cast<size_t>(books) ? 0 : 1;
+}
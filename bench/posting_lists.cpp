@@ -0,0 +1,117 @@
+// Compares PostingList with the unordered_set<int> the secondary indexes used
+// before, on an index shaped like books_by_genre_: a few large genres holding
+// most books and a long tail of small ones. Reports heap bytes per indexed id,
+// the time to build the index, to read the largest key's ids in ascending
+// order (the set has to be copied and sorted for that), to probe membership
+// and to erase every other id of the largest key. Heap usage comes from
+// glibc's allocator statistics, as in user_storage.
+//
+// Usage: posting_lists [books] [keys]
+#include "posting_list.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+struct Result {
+    double bytes_per_id = 0;
+    double build_s = 0;
+    double ordered_scan_s = 0;
+    double probe_ns = 0;
+    double erase_s = 0;
+    long long checksum = 0;
+};
+
+// key_of[id] is the key of book id; probes are random ids checked against key 0.
+// scan(set, visit) calls visit(id) for the set's ids in ascending order.
+template <typename Set, typename Scan>
+static Result run(const std::vector<int>& key_of, int keys, const std::vector<int>& probes, Scan&& scan) {
+    Result result;
+    double before = heap_bytes();
+    std::unordered_map<int, Set> index;
+    result.build_s = seconds_of([&] {
+        for (size_t id = 0; id < key_of.size(); ++id) {
+            index[key_of[id]].insert(static_cast<int>(id));
+        }
+    });
+    result.bytes_per_id = (heap_bytes() - before) / static_cast<double>(key_of.size());
+
+    const Set& largest = index[0];
+    result.ordered_scan_s = seconds_of([&] {
+        scan(largest, [&](int id) { result.checksum += id; });
+    });
+    double probe_s = seconds_of([&] {
+        for (int id : probes) {
+            result.checksum += largest.count(id);
+        }
+    });
+    result.probe_ns = probe_s * 1e9 / static_cast<double>(probes.size());
+    std::vector<int> to_erase;
+    scan(largest, [&](int id) { to_erase.push_back(id); });
+    result.erase_s = seconds_of([&] {
+        for (size_t i = 0; i < to_erase.size(); i += 2) {
+            index[0].erase(to_erase[i]);
+        }
+    });
+    result.checksum += static_cast<long long>(index[0].size()) + keys;
+    return result;
+}
+
+// PostingList under the interface the benchmark uses for unordered_set.
+struct CountingPostingList : PostingList {
+    size_t count(int id) const { return contains(id) ? 1 : 0; }
+};
+
+int main(int argc, char* argv[]) {
+    int books = argc > 1 ? std::atoi(argv[1]) : 2000000;
+    int keys = argc > 2 ? std::atoi(argv[2]) : 1000;
+    if (books <= 0 || keys <= 0) {
+        std::fprintf(stderr, "usage: %s [books] [keys]\n", argv[0]);
+        return 2;
+    }
+    // Zipf-like skew: key k is chosen with weight 1 / (k + 1).
+    std::vector<double> weights(static_cast<size_t>(keys));
+    for (int key = 0; key < keys; ++key) {
+        weights[static_cast<size_t>(key)] = 1.0 / (key + 1);
+    }
+    std::mt19937 random(42);
+    std::discrete_distribution<int> pick_key(weights.begin(), weights.end());
+    std::vector<int> key_of(static_cast<size_t>(books));
+    for (int& key : key_of) {
+        key = pick_key(random);
+    }
+    std::uniform_int_distribution<int> pick_id(0, books - 1);
+    std::vector<int> probes(1000000);
+    for (int& id : probes) {
+        id = pick_id(random);
+    }
+
+    Result legacy = run<std::unordered_set<int>>(key_of, keys, probes, [](const std::unordered_set<int>& set, auto&& visit) {
+        std::vector<int> ids(set.begin(), set.end());
+        std::sort(ids.begin(), ids.end());
+        for (int id : ids) {
+            visit(id);
+        }
+    });
+    Result postings = run<CountingPostingList>(key_of, keys, probes, [](const CountingPostingList& list, auto&& visit) {
+        for (int id : list) {
+            visit(id);
+        }
+    });
+
+    std::printf("{\"bench\":\"posting_lists\",\"books\":%d,\"keys\":%d,"
+                "\"unordered_set\":{\"bytes_per_id\":%.1f,\"build_s\":%.3f,\"ordered_scan_s\":%.4f,\"probe_ns\":%.1f,\"erase_s\":%.4f},"
+                "\"posting_list\":{\"bytes_per_id\":%.1f,\"build_s\":%.3f,\"ordered_scan_s\":%.4f,\"probe_ns\":%.1f,\"erase_s\":%.4f},"
+                "\"checksums_match\":%s}\n",
+                books, keys,
+                legacy.bytes_per_id, legacy.build_s, legacy.ordered_scan_s, legacy.probe_ns, legacy.erase_s,
+                postings.bytes_per_id, postings.build_s, postings.ordered_scan_s, postings.probe_ns, postings.erase_s,
+                legacy.checksum == postings.checksum ? "true" : "false");
+    return legacy.checksum == postings.checksum ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+// Memory per user and lookup latency of UserStore against the layout it
+// replaced: an unordered_map from id to shared_ptr of a polymorphic user that
+// owns its name and email strings. Heap usage is read from glibc's allocator
+// statistics before and after each directory is built, so it includes the
+// allocator's own per-block overhead.
+//
+// Usage: user_storage [users] [lookups]
+#include "library.h"
+#include "bench_util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// The user class as it was before the policy table and the value-type store.
+class LegacyUser {
+public:
+    LegacyUser(std::string name, std::string email, int id) : name_(std::move(name)), email_(std::move(email)), id_(id) {}
+    virtual ~LegacyUser() = default;
+    virtual UserType get_user_type() const = 0;
+    int get_penalty_value() const { return penalty_; }
+
+private:
+    std::string name_, email_;
+    int id_, penalty_ = 0;
+    std::vector<Book> borrowed_books_;
+};
+
+class LegacyStudent : public LegacyUser {
+public:
+    using LegacyUser::LegacyUser;
+    UserType get_user_type() const override { return UserType::STUDENT; }
+};
+
+
+static std::string name_of(int id) { return "Patron " + std::to_string(id); }
+static std::string email_of(int id) { return "patron" + std::to_string(id) + "@library.example.org"; }
+
+template <typename F>
+static double nanoseconds_per(int count, F&& body) {
+    return seconds_of(body) * 1e9 / count;
+}
+
+int main(int argc, char* argv[]) {
+    int users = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int lookups = argc > 2 ? std::atoi(argv[2]) : 5000000;
+    if (users <= 0 || lookups <= 0) {
+        std::fprintf(stderr, "usage: %s [users] [lookups]\n", argv[0]);
+        return 2;
+    }
+    std::vector<int> probes(lookups);
+    std::mt19937 random(42);
+    for (int& id : probes) {
+        id = static_cast<int>(random() % users);
+    }
+
+    double before = heap_bytes();
+    auto legacy = std::make_unique<std::unordered_map<int, std::shared_ptr<LegacyUser>>>();
+    for (int id = 0; id < users; ++id) {
+        legacy->emplace(id, std::make_shared<LegacyStudent>(name_of(id), email_of(id), id));
+    }
+    double legacy_bytes = (heap_bytes() - before) / users;
+
+    // Includes the strings interned into the shared pool.
+    before = heap_bytes();
+    auto store = std::make_unique<UserStore>();
+    for (int id = 0; id < users; ++id) {
+        store->insert(Student(name_of(id), email_of(id), id));
+    }
+    double store_bytes = (heap_bytes() - before) / users;
+
+    Library<std::chrono::hours> library(std::chrono::hours(24));
+    for (int id = 0; id < users; ++id) {
+        library.add_user(Student(name_of(id), email_of(id), id));
+    }
+
+    long long checksum = 0;
+    // What get_user_by_id did before: a hash lookup plus a shared_ptr copy.
+    double legacy_ns = nanoseconds_per(lookups, [&] {
+        for (int id : probes) {
+            std::shared_ptr<LegacyUser> user = legacy->find(id)->second;
+            checksum += user->get_penalty_value();
+        }
+    });
+    double store_ns = nanoseconds_per(lookups, [&] {
+        for (int id : probes) {
+            checksum += store->find(id)->get_penalty_value();
+        }
+    });
+    double library_ns = nanoseconds_per(lookups, [&] {
+        for (int id : probes) {
+            checksum += library.get_user_by_id(id)->get_penalty_value();
+        }
+    });
+
+    std::printf("{\"bench\":\"user_storage\",\"users\":%d,\"lookups\":%d,"
+                "\"legacy_bytes_per_user\":%.1f,\"store_bytes_per_user\":%.1f,"
+                "\"legacy_lookup_ns\":%.1f,\"store_lookup_ns\":%.1f,\"library_get_user_by_id_ns\":%.1f,"
+                "\"checksum\":%lld}\n",
+                users, lookups, legacy_bytes, store_bytes, legacy_ns, store_ns, library_ns, checksum);
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Seeded synthetic load on one Library from several threads, for catching
+// throughput and tail-latency regressions. Book popularity is Zipfian (rank
+// k is picked with weight 1 / (k + 1)^s, ranks shuffled over the ids), and
+// patrons are 60% students, 25% faculty and 15% guests, so borrow limits
+// differ. Each operation is a read with probability read_percent:
+//
+//   reads   get_book_by_id 50%, get_books_by_author 25%, get_user_by_id 15%,
+//           search_books on a word of a title 10%
+//   writes  borrow_book by a random patron; if the book is out, return_book
+//
+// Every call is timed. One JSON object reports throughput, p50/p99/p999
+// latency overall and for reads and writes, peak RSS, and whether the
+// patrons' loans still add up to the borrowed books afterwards.
+//
+// Usage: workload [operations] [read_percent] [zipf_s] [threads] [seed] [books] [users]
+#include "library.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using DayLibrary = Library<std::chrono::hours>;
+
+struct Latencies {
+    std::vector<std::uint32_t> reads, writes; // nanoseconds
+};
+
+struct Percentiles {
+    double p50 = 0, p99 = 0, p999 = 0;
+};
+
+static Percentiles percentiles_of(std::vector<std::uint32_t>& samples) {
+    Percentiles result;
+    if (samples.empty()) {
+        return result;
+    }
+    auto at = [&](double fraction) {
+        auto nth = samples.begin() + static_cast<std::ptrdiff_t>(fraction * static_cast<double>(samples.size() - 1));
+        std::nth_element(samples.begin(), nth, samples.end());
+        return static_cast<double>(*nth);
+    };
+    result.p50 = at(0.5);
+    result.p99 = at(0.99);
+    result.p999 = at(0.999);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    long long operations = argc > 1 ? std::atoll(argv[1]) : 2000000;
+    int read_percent = argc > 2 ? std::atoi(argv[2]) : 80;
+    double zipf_s = argc > 3 ? std::atof(argv[3]) : 0.99;
+    int threads = argc > 4 ? std::atoi(argv[4]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    unsigned seed = argc > 5 ? static_cast<unsigned>(std::atoi(argv[5])) : 1;
+    int books = argc > 6 ? std::atoi(argv[6]) : 100000;
+    int users = argc > 7 ? std::atoi(argv[7]) : 20000;
+    if (operations <= 0 || read_percent < 0 || read_percent > 100 || zipf_s < 0 || threads <= 0 || books <= 0 || users <= 0) {
+        std::fprintf(stderr, "usage: %s [operations] [read_percent] [zipf_s] [threads] [seed] [books] [users]\n", argv[0]);
+        return 2;
+    }
+
+    std::mt19937 random(seed);
+    DayLibrary library(std::chrono::hours(24));
+    std::vector<std::string> authors(static_cast<size_t>(books)), title_words(static_cast<size_t>(books));
+    for (int id = 0; id < books; ++id) {
+        title_words[static_cast<size_t>(id)] = "word" + std::to_string(random() % static_cast<unsigned>(books / 4 + 1));
+        authors[static_cast<size_t>(id)] = "Author " + std::to_string(random() % static_cast<unsigned>(books / 20 + 1));
+        library.add_book(Book("The " + title_words[static_cast<size_t>(id)] + " Story", authors[static_cast<size_t>(id)],
+                              "Genre " + std::to_string(random() % 50), id));
+    }
+    std::discrete_distribution<int> pick_type({60, 25, 15});
+    for (int i = 0; i < users; ++i) {
+        static constexpr UserType kTypes[] = {UserType::STUDENT, UserType::FACULTY, UserType::GUEST};
+        library.add_user(User(kTypes[pick_type(random)], "Patron", "patron@example.org", books + i));
+    }
+    std::vector<double> weights(static_cast<size_t>(books));
+    for (int rank = 0; rank < books; ++rank) {
+        weights[static_cast<size_t>(rank)] = 1.0 / std::pow(rank + 1, zipf_s);
+    }
+    std::vector<int> book_of_rank(static_cast<size_t>(books));
+    std::iota(book_of_rank.begin(), book_of_rank.end(), 0);
+    std::shuffle(book_of_rank.begin(), book_of_rank.end(), random);
+    const std::discrete_distribution<int> pick_rank(weights.begin(), weights.end());
+
+    std::vector<Latencies> latencies(static_cast<size_t>(threads));
+    std::vector<long long> checksums(static_cast<size_t>(threads), 0);
+    auto work = [&](int thread) {
+        std::mt19937 random(seed * 7919 + static_cast<unsigned>(thread));
+        std::discrete_distribution<int> rank = pick_rank;
+        std::uniform_int_distribution<int> percent(0, 99), kind(0, 19), patron(books, books + users - 1);
+        Latencies& mine = latencies[static_cast<size_t>(thread)];
+        long long count = operations / threads + (thread < operations % threads ? 1 : 0);
+        mine.reads.reserve(static_cast<size_t>(count * read_percent / 100 + count / 50 + 16));
+        mine.writes.reserve(static_cast<size_t>(count - count * read_percent / 100 + count / 50 + 16));
+        long long checksum = 0;
+        for (long long i = 0; i < count; ++i) {
+            int book_id = book_of_rank[static_cast<size_t>(rank(random))];
+            bool read = percent(random) < read_percent;
+            int read_kind = kind(random);
+            int user_id = patron(random);
+            auto started = std::chrono::steady_clock::now();
+            if (!read) {
+                if (library.try_borrow_book(user_id, book_id) == LibraryError::BOOK_NOT_AVAILABLE) {
+                    checksum += library.try_return_book(book_id).penalty;
+                }
+            } else if (read_kind < 10) {
+                checksum += library.get_book_by_id(book_id).has_value();
+            } else if (read_kind < 15) {
+                checksum += static_cast<long long>(library.get_books_by_author(authors[static_cast<size_t>(book_id)]).size());
+            } else if (read_kind < 18) {
+                checksum += library.get_user_by_id(user_id).has_value();
+            } else {
+                checksum += static_cast<long long>(library.search_books(title_words[static_cast<size_t>(book_id)], 10).size());
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+            (read ? mine.reads : mine.writes).push_back(static_cast<std::uint32_t>(std::min<long long>(elapsed, UINT32_MAX)));
+        }
+        checksums[static_cast<size_t>(thread)] = checksum;
+    };
+
+    library.search_books("warm up the word index", 1);
+    double seconds = seconds_of([&] {
+        std::vector<std::thread> workers;
+        for (int thread = 0; thread < threads; ++thread) {
+            workers.emplace_back(work, thread);
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    });
+
+    size_t loans = 0;
+    library.for_each_user([&](const User& user) { loans += user.borrowed_count(); });
+    bool consistent = loans == library.get_borrowed_books().size();
+
+    Latencies all;
+    for (auto& thread : latencies) {
+        all.reads.insert(all.reads.end(), thread.reads.begin(), thread.reads.end());
+        all.writes.insert(all.writes.end(), thread.writes.begin(), thread.writes.end());
+    }
+    std::vector<std::uint32_t> every(all.reads);
+    every.insert(every.end(), all.writes.begin(), all.writes.end());
+    Percentiles total = percentiles_of(every), reads = percentiles_of(all.reads), writes = percentiles_of(all.writes);
+    std::printf("{\"bench\":\"workload\",\"operations\":%lld,\"read_percent\":%d,\"zipf_s\":%.2f,\"threads\":%d,\"seed\":%u,"
+                "\"books\":%d,\"users\":%d,\"ops_per_s\":%.0f,"
+                "\"latency_ns\":{\"all\":{\"p50\":%.0f,\"p99\":%.0f,\"p999\":%.0f},"
+                "\"read\":{\"p50\":%.0f,\"p99\":%.0f,\"p999\":%.0f},\"write\":{\"p50\":%.0f,\"p99\":%.0f,\"p999\":%.0f}},"
+                "\"peak_rss_mb\":%.1f,\"loans\":%zu,\"consistent\":%s,\"checksum\":%lld}\n",
+                operations, read_percent, zipf_s, threads, seed, books, users, static_cast<double>(operations) / seconds,
+                total.p50, total.p99, total.p999, reads.p50, reads.p99, reads.p999, writes.p50, writes.p99, writes.p999,
+                peak_rss_mb(), loans, consistent ? "true" : "false",
+                std::accumulate(checksums.begin(), checksums.end(), 0LL));
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+
+inline int count_trailing_zeros(std::uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    int count = 0;
+    while ((word & 1) == 0) {
+        word >>= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Precondition: word != 0.
+inline int count_leading_zeros(std::uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(word);
+#else
+    int count = 0;
+    while ((word & (std::uint64_t{1} << 63)) == 0) {
+        word <<= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
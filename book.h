@@ -1,7 +1,11 @@
 #pragma once
+#include <atomic>
 #include <chrono>
 #include <string>
+#include <string_view>
 #include <ctime>
+#include "string_pool.h"
+#include "time_source.h"
 
 
 template<class T> 
@@ -20,21 +24,42 @@ public:
     std::chrono::seconds day_length() const { return day_duration_; }
 
 
+    // Reads system_clock unless a source is set; the source must outlive the
+    // clock or be replaced first.
+    std::chrono::system_clock::time_point now() const {
+        const TimeSource* source = source_.load(std::memory_order_acquire);
+        return source ? source->now() : std::chrono::system_clock::now();
+    }
+
+    void set_source(const TimeSource* source) {
+        source_.store(source, std::memory_order_release);
+    }
+
     int days_since(std::chrono::system_clock::time_point start) const {
-        auto now = std::chrono::system_clock::now();
-        auto diff = now - start;
+        return days_between(start, now());
+    }
+
+    int days_between(std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end) const {
+        auto diff = end - start;
         return std::chrono::duration_cast<std::chrono::seconds>(diff).count()
             / day_duration_.count();
     }
 
 private:
     std::chrono::seconds day_duration_;
+    std::atomic<const TimeSource*> source_{nullptr};
 };
 
+// Name, author and genre are interned in string_pool(), so a Book is a small
+// value type and copying it never touches the heap.
 class Book {
 public:
-    Book(std::string name, std::string author, std::string genre, int id)
-        : name_(std::move(name)), author_(std::move(author)), genre_(std::move(genre)), id_(id) {}
+    Book(std::string_view name, std::string_view author, std::string_view genre, int id)
+        : name_(string_pool().intern(name)), author_(string_pool().intern(author)),
+          genre_(string_pool().intern(genre)), id_(id) {}
+
+    Book(Symbol name, Symbol author, Symbol genre, int id)
+        : name_(name), author_(author), genre_(genre), id_(id) {}
 
     bool is_available() const { return available_; }
 
@@ -43,9 +68,9 @@ public:
         taken_time_ = {};
     }
 
-    void take() {
+    void take(std::chrono::system_clock::time_point taken_time) {
         available_ = false;
-        taken_time_ = std::chrono::system_clock::now();
+        taken_time_ = taken_time;
     }
 
     std::chrono::system_clock::time_point get_taken_time() const {
@@ -54,11 +79,17 @@ public:
 
 
 
-    std::string get_genre() const { return this->genre_; }
+    std::string_view get_genre() const { return string_pool().str(this->genre_); }
+
+    std::string_view get_author() const { return string_pool().str(this->author_); }
+
+    std::string_view get_name() const { return string_pool().str(this->name_); }
+
+    Symbol get_genre_symbol() const { return this->genre_; }
 
-    std::string get_author() const { return this->author_; }
+    Symbol get_author_symbol() const { return this->author_; }
 
-    std::string get_name() const { return this->name_; }
+    Symbol get_name_symbol() const { return this->name_; }
 
     int get_id() const { return this->id_; }
 
@@ -85,7 +116,7 @@ public:
     ~Book() = default;
 
 private:
-    std::string name_, author_, genre_;
+    Symbol name_, author_, genre_;
     int id_;
     bool available_ = true;
     std::chrono::system_clock::time_point taken_time_{};
@@ -0,0 +1,71 @@
+#pragma once
+#include "catalog_file.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+// Conjunction of book filters; unset filters match every book. Attribute
+// filters match whole values, as get_books_by_author() and friends do, e.g.
+//
+//   BookQuery query;
+//   query.author = "Ursula K. Le Guin";
+//   query.genre = "Fantasy";
+//   query.available_only = true;
+struct BookQuery {
+    std::optional<std::string> author;
+    std::optional<std::string> genre;
+    std::optional<std::string> name;
+    bool available_only = false;
+
+    const std::optional<std::string>& value_of(CatalogAttribute attribute) const {
+        switch (attribute) {
+        case CatalogAttribute::AUTHOR: return author;
+        case CatalogAttribute::GENRE: return genre;
+        default: return name;
+        }
+    }
+};
+
+
+// How a query is evaluated: the ids of its most selective attribute filter
+// (the driver), taken once and sorted, are intersected with the other
+// attribute filters by galloping through their sorted ids, and the survivors
+// are walked in order. A query without attribute filters lists the ids of all
+// books instead, or of the available ones from the availability bitmap, so a
+// book that becomes available after planning is not listed. Each page checks
+// its candidates again; only the position in the walk is kept between pages.
+struct QueryPlan {
+    BookQuery query;
+    std::optional<CatalogAttribute> driver;
+    std::vector<int> candidates; // ascending
+    size_t position = 0;         // next candidate
+
+    bool done() const { return position == candidates.size(); }
+};
+
+
+// Lazily produced result of a query, one page of ascending book ids at a time.
+// Every page is evaluated against the library as it is when the page is asked
+// for, so a book changed between pages is judged by its new state; a book is
+// never returned twice. The cursor must not outlive the library.
+template <typename Source>
+class BookCursor {
+public:
+    BookCursor(const Source& source, QueryPlan plan) : source_(&source), plan_(std::move(plan)) {}
+
+    // Up to page_size more matching ids; empty once the cursor is done.
+    std::vector<int> next_page(size_t page_size) {
+        return source_->next_query_page(plan_, page_size);
+    }
+
+    bool done() const { return plan_.done(); }
+
+    // Which filter the planner started from, if any (for diagnostics).
+    std::optional<CatalogAttribute> driver() const { return plan_.driver; }
+
+private:
+    const Source* source_;
+    QueryPlan plan_;
+};
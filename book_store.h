@@ -0,0 +1,278 @@
+#pragma once
+#include "book.h"
+#include "bits.h"
+#include "slot_index.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+
+// Struct-of-arrays book catalog. Books live in dense slots; every field is a
+// separate column indexed by slot, and ids map to slots through a SlotIndex
+// (IdGenerator hands out small increasing ids, so its vector stays dense).
+// Slots of removed books go on a free list and are reused by later inserts.
+//
+// Availability and occupancy are kept as bitsets so scans over borrowed or
+// available books touch 64 slots per word and skip the string symbols entirely.
+//
+// Inserting and erasing need exclusive access. A loan is started in two steps:
+// try_claim() sets the slot's owner word with compare-and-swap, so concurrent
+// borrowers of one book need no lock to agree on a single winner, and take()
+// then publishes the loan times and clears the availability bit. take() and
+// give_back() only touch their own slot, plus an atomic update of the
+// availability word, so they may run concurrently for different books.
+class BookStore {
+public:
+    using time_point = std::chrono::system_clock::time_point;
+
+    static constexpr int kNoOwner = -1;
+    static constexpr int kSetAside = -2; // returned, kept for the next holder by set_aside()
+
+    bool contains(int book_id) const {
+        return slot_of(book_id) != kNoSlot;
+    }
+
+    size_t size() const { return ids_.size() - free_slots_.size(); }
+
+    // Makes room for `count` books in total, so inserting them grows no column.
+    void reserve(size_t count) {
+        ids_.reserve(count);
+        names_.reserve(count);
+        authors_.reserve(count);
+        genres_.reserve(count);
+        taken_times_.reserve(count);
+        due_times_.reserve(count);
+        accrued_days_.reserve(count);
+        occupied_bits_.reserve((count + 63) / 64);
+        grow_atomic(owners_, count);
+        grow_atomic(available_bits_, (count + 63) / 64);
+    }
+
+    // Precondition: book_id >= 0 and !contains(book_id).
+    void insert(const Book& book) {
+        int book_id = book.get_id();
+        std::uint32_t slot;
+        if (!free_slots_.empty()) {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+        } else {
+            slot = static_cast<std::uint32_t>(ids_.size());
+            ids_.push_back(-1);
+            names_.emplace_back();
+            authors_.emplace_back();
+            genres_.emplace_back();
+            grow_atomic(owners_, ids_.size());
+            taken_times_.emplace_back();
+            due_times_.emplace_back();
+            accrued_days_.emplace_back();
+            if (slot % 64 == 0) {
+                occupied_bits_.push_back(0);
+                grow_atomic(available_bits_, occupied_bits_.size());
+            }
+        }
+        slots_.insert(book_id, slot);
+
+        ids_[slot] = book_id;
+        names_[slot] = book.get_name_symbol();
+        authors_[slot] = book.get_author_symbol();
+        genres_[slot] = book.get_genre_symbol();
+        owners_[slot].store(kNoOwner, std::memory_order_relaxed);
+        taken_times_[slot] = book.get_taken_time();
+        due_times_[slot] = {};
+        accrued_days_[slot] = 0;
+        set_bit(occupied_bits_, slot, true);
+        set_available(slot, book.is_available());
+    }
+
+    // Precondition: contains(book_id).
+    void erase(int book_id) {
+        std::uint32_t slot = slots_.find(book_id);
+        slots_.erase(book_id);
+        ids_[slot] = -1;
+        set_bit(occupied_bits_, slot, false);
+        set_available(slot, false);
+        free_slots_.push_back(slot);
+    }
+
+    // Materializes the stored book; cheap, since all strings are interned.
+    Book get(int book_id) const {
+        return book_at(slot_of(book_id));
+    }
+
+    bool is_available(int book_id) const {
+        return test_available(slot_of(book_id));
+    }
+
+    // The claimed owner, which may be ahead of what get() and is_available() show.
+    int owner(int book_id) const { return owners_[slot_of(book_id)].load(std::memory_order_acquire); }
+
+    Symbol name(int book_id) const { return names_[slot_of(book_id)]; }
+
+    Symbol author(int book_id) const { return authors_[slot_of(book_id)]; }
+
+    Symbol genre(int book_id) const { return genres_[slot_of(book_id)]; }
+
+    time_point taken_time(int book_id) const { return taken_times_[slot_of(book_id)]; }
+
+    time_point due_time(int book_id) const { return due_times_[slot_of(book_id)]; }
+
+    // Overdue days of the current loan already charged to its owner.
+    int accrued_days(int book_id) const { return accrued_days_[slot_of(book_id)]; }
+
+    void add_accrued_days(int book_id, int days) { accrued_days_[slot_of(book_id)] += days; }
+
+    // Exactly one of several concurrent callers for the same book succeeds.
+    bool try_claim(int book_id, int user_id) {
+        int expected = kNoOwner;
+        return owners_[slot_of(book_id)].compare_exchange_strong(expected, user_id, std::memory_order_acq_rel);
+    }
+
+    // Precondition: the caller's try_claim() for this book succeeded.
+    void take(int book_id, time_point taken_time, time_point due_time) {
+        std::uint32_t slot = slot_of(book_id);
+        taken_times_[slot] = taken_time;
+        due_times_[slot] = due_time;
+        set_available(slot, false);
+    }
+
+    // Releases the claim last, so the next borrower sees a fully returned slot.
+    void give_back(int book_id) {
+        std::uint32_t slot = slot_of(book_id);
+        taken_times_[slot] = {};
+        due_times_[slot] = {};
+        accrued_days_[slot] = 0;
+        set_available(slot, true);
+        owners_[slot].store(kNoOwner, std::memory_order_release);
+    }
+
+    // Like give_back, but the book stays claimed and unavailable, so it can't
+    // be borrowed until hand_over() lends it to a holder or release() frees it.
+    void set_aside(int book_id) {
+        std::uint32_t slot = slot_of(book_id);
+        taken_times_[slot] = {};
+        due_times_[slot] = {};
+        accrued_days_[slot] = 0;
+        owners_[slot].store(kSetAside, std::memory_order_release);
+    }
+
+    // Precondition: the book is set aside. take() must follow, as after try_claim().
+    void hand_over(int book_id, int user_id) {
+        owners_[slot_of(book_id)].store(user_id, std::memory_order_release);
+    }
+
+    // Precondition: the book is set aside. Releases the claim last, as give_back does.
+    void release(int book_id) {
+        std::uint32_t slot = slot_of(book_id);
+        set_available(slot, true);
+        owners_[slot].store(kNoOwner, std::memory_order_release);
+    }
+
+    template <typename F>
+    void for_each(F&& visit) const {
+        for_each_slot([](std::uint64_t occupied, std::uint64_t) { return occupied; },
+                      [&](std::uint32_t slot) { visit(book_at(slot)); });
+    }
+
+    // visit(book_id) for every book, or every available one, in slot order
+    template <typename F>
+    void for_each_id(bool available_only, F&& visit) const {
+        for_each_slot([&](std::uint64_t occupied, std::uint64_t available) {
+                          return available_only ? occupied & available : occupied;
+                      },
+                      [&](std::uint32_t slot) { visit(ids_[slot]); });
+    }
+
+    // visit(book_id, owner_id, taken_time) for every book that is currently
+    // out; books set aside for a holder are unavailable but not on loan.
+    template <typename F>
+    void for_each_borrowed(F&& visit) const {
+        for_each_slot([](std::uint64_t occupied, std::uint64_t available) { return occupied & ~available; },
+                      [&](std::uint32_t slot) {
+                          int owner = owners_[slot].load(std::memory_order_relaxed);
+                          if (owner != kSetAside) {
+                              visit(ids_[slot], owner, taken_times_[slot]);
+                          }
+                      });
+    }
+
+private:
+    static constexpr std::uint32_t kNoSlot = SlotIndex::kNoSlot;
+
+    std::uint32_t slot_of(int book_id) const { return slots_.find(book_id); }
+
+    Book book_at(std::uint32_t slot) const {
+        Book book(names_[slot], authors_[slot], genres_[slot], ids_[slot]);
+        if (!test_available(slot)) {
+            book.take(taken_times_[slot]);
+        }
+        return book;
+    }
+
+    // Calls on_slot for every slot whose bit is set in select(occupied, available).
+    template <typename Select, typename OnSlot>
+    void for_each_slot(Select&& select, OnSlot&& on_slot) const {
+        for (size_t word_index = 0; word_index < occupied_bits_.size(); ++word_index) {
+            std::uint64_t word = select(occupied_bits_[word_index],
+                                        available_bits_[word_index].load(std::memory_order_relaxed));
+            while (word != 0) {
+                int bit = count_trailing_zeros(word);
+                on_slot(static_cast<std::uint32_t>(word_index * 64 + bit));
+                word &= word - 1;
+            }
+        }
+    }
+
+    static void set_bit(std::vector<std::uint64_t>& bits, std::uint32_t slot, bool value) {
+        std::uint64_t mask = std::uint64_t{1} << (slot % 64);
+        if (value) {
+            bits[slot / 64] |= mask;
+        } else {
+            bits[slot / 64] &= ~mask;
+        }
+    }
+
+    // Neighbouring slots share a word, so availability changes are atomic
+    // read-modify-writes; the slot's own fields are ordered by the caller's lock.
+    void set_available(std::uint32_t slot, bool value) {
+        std::uint64_t mask = std::uint64_t{1} << (slot % 64);
+        if (value) {
+            available_bits_[slot / 64].fetch_or(mask, std::memory_order_relaxed);
+        } else {
+            available_bits_[slot / 64].fetch_and(~mask, std::memory_order_relaxed);
+        }
+    }
+
+    bool test_available(std::uint32_t slot) const {
+        return (available_bits_[slot / 64].load(std::memory_order_relaxed) >> (slot % 64)) & 1;
+    }
+
+    // std::atomic can't be moved, so the values are copied into a larger vector.
+    template <typename T>
+    static void grow_atomic(std::vector<std::atomic<T>>& column, size_t size) {
+        if (size <= column.size()) {
+            return;
+        }
+        std::vector<std::atomic<T>> grown(std::max(size, column.size() * 2));
+        for (size_t i = 0; i < column.size(); ++i) {
+            grown[i].store(column[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        column.swap(grown);
+    }
+
+    SlotIndex slots_;
+    std::vector<std::uint32_t> free_slots_;
+
+    // Columns, indexed by slot.
+    std::vector<int> ids_;
+    std::vector<Symbol> names_;
+    std::vector<Symbol> authors_;
+    std::vector<Symbol> genres_;
+    std::vector<std::atomic<int>> owners_; // user_id, or kNoOwner; may be longer than ids_
+    std::vector<time_point> taken_times_;
+    std::vector<time_point> due_times_;
+    std::vector<int> accrued_days_;
+    std::vector<std::uint64_t> occupied_bits_;
+    std::vector<std::atomic<std::uint64_t>> available_bits_; // may be longer than occupied_bits_
+};
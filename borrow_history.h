@@ -0,0 +1,256 @@
+#pragma once
+#include "write_ahead_log.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+enum class BorrowOperationType {
+    BORROW,
+    RETURN
+};
+
+
+struct BorrowEvent {
+    int user_id;
+    int book_id;
+    BorrowOperationType op_type;
+    std::chrono::system_clock::time_point time;
+};
+
+
+// Selects events of one user and/or one book within [from, to].
+struct HistoryQuery {
+    std::optional<int> user_id;
+    std::optional<int> book_id;
+    std::chrono::system_clock::time_point from = std::chrono::system_clock::time_point::min();
+    std::chrono::system_clock::time_point to = std::chrono::system_clock::time_point::max();
+
+    bool matches(const BorrowEvent& event) const {
+        return (!user_id || event.user_id == *user_id) && (!book_id || event.book_id == *book_id)
+            && event.time >= from && event.time <= to;
+    }
+};
+
+
+// Append-only borrow/return history, stored column by column in chunks of
+// kChunkEvents events. The newest chunk is kept as plain arrays; once it fills
+// up it is sealed: each column is delta-encoded into varints (operations as
+// bits), which takes a few bytes per event instead of twenty-odd. Every sealed
+// chunk keeps the min/max of its user ids, book ids and times, so a query only
+// decodes the chunks that may hold a match.
+//
+// Retention is a ring of chunks: once more than retention() events are held,
+// the oldest chunks are dropped, always keeping at least retention() events.
+// Times are kept to the microsecond, like in the log.
+//
+// Not synchronized; Library guards it with its history lock.
+class BorrowHistory {
+public:
+    static constexpr size_t kChunkEvents = 4096;
+    static constexpr size_t kDefaultRetention = size_t{1} << 24;
+
+    explicit BorrowHistory(size_t retention = kDefaultRetention) : retention_(std::max<size_t>(retention, 1)) {}
+
+    size_t size() const { return sealed_events_ + open_.size(); }
+
+    // Events dropped by retention since the history was created.
+    std::uint64_t dropped() const { return dropped_; }
+
+    size_t retention() const { return retention_; }
+
+    void set_retention(size_t events) {
+        retention_ = std::max<size_t>(events, 1);
+        trim();
+    }
+
+    // Bytes held by the events themselves (sealed chunks plus the open one).
+    size_t memory_bytes() const {
+        size_t bytes = open_.size() * (sizeof(int) * 2 + sizeof(std::uint8_t) + sizeof(std::int64_t));
+        for (const auto& chunk : sealed_) {
+            bytes += chunk.data.size() + sizeof(SealedChunk);
+        }
+        return bytes;
+    }
+
+    void append(const BorrowEvent& event) {
+        open_.push_back(event.user_id, event.book_id, event.op_type, to_micros(event.time));
+        if (open_.size() == kChunkEvents) {
+            seal();
+        }
+        trim();
+    }
+
+    void clear() {
+        sealed_.clear();
+        open_.clear();
+        sealed_events_ = 0;
+    }
+
+    // visit(const BorrowEvent&), oldest first
+    template <typename F>
+    void for_each(F&& visit) const {
+        ChunkColumns scratch;
+        for (const auto& chunk : sealed_) {
+            decode(chunk, scratch);
+            scratch.for_each(visit);
+        }
+        open_.for_each(visit);
+    }
+
+    // visit(const BorrowEvent&) for each matching event, oldest first
+    template <typename F>
+    void for_each(const HistoryQuery& query, F&& visit) const {
+        auto visit_matching = [&](const BorrowEvent& event) {
+            if (query.matches(event)) {
+                visit(event);
+            }
+        };
+        std::int64_t from = to_micros(query.from), to = to_micros(query.to);
+        ChunkColumns scratch;
+        for (const auto& chunk : sealed_) {
+            const Summary& summary = chunk.summary;
+            if (summary.max_time < from || summary.min_time > to
+                || (query.user_id && (*query.user_id < summary.min_user || *query.user_id > summary.max_user))
+                || (query.book_id && (*query.book_id < summary.min_book || *query.book_id > summary.max_book))) {
+                continue;
+            }
+            decode(chunk, scratch);
+            scratch.for_each(visit_matching);
+        }
+        open_.for_each(visit_matching);
+    }
+
+private:
+    struct Summary {
+        int min_user, max_user;
+        int min_book, max_book;
+        std::int64_t min_time, max_time;
+    };
+
+    struct SealedChunk {
+        Summary summary;
+        std::uint32_t count;
+        std::string data; // users, books, times as zigzag delta varints, then operation bits
+    };
+
+    struct ChunkColumns {
+        std::vector<int> users;
+        std::vector<int> books;
+        std::vector<std::uint8_t> ops;
+        std::vector<std::int64_t> times; // microseconds since the epoch
+
+        size_t size() const { return users.size(); }
+
+        void push_back(int user_id, int book_id, BorrowOperationType op_type, std::int64_t time) {
+            users.push_back(user_id);
+            books.push_back(book_id);
+            ops.push_back(static_cast<std::uint8_t>(op_type));
+            times.push_back(time);
+        }
+
+        void clear() {
+            users.clear();
+            books.clear();
+            ops.clear();
+            times.clear();
+        }
+
+        template <typename F>
+        void for_each(F& visit) const {
+            for (size_t i = 0; i < size(); ++i) {
+                visit(BorrowEvent{users[i], books[i], static_cast<BorrowOperationType>(ops[i]), from_micros(times[i])});
+            }
+        }
+    };
+
+    static std::int64_t to_micros(std::chrono::system_clock::time_point time) {
+        using std::chrono::system_clock;
+        if (time == system_clock::time_point::min()) return std::numeric_limits<std::int64_t>::min();
+        if (time == system_clock::time_point::max()) return std::numeric_limits<std::int64_t>::max();
+        return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+    }
+
+    static std::chrono::system_clock::time_point from_micros(std::int64_t micros) {
+        return std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(micros)));
+    }
+
+    template <typename T>
+    static void encode_deltas(BinaryWriter& out, const std::vector<T>& column) {
+        std::int64_t previous = 0;
+        for (T value : column) {
+            out.svarint(static_cast<std::int64_t>(value) - previous);
+            previous = value;
+        }
+    }
+
+    template <typename T>
+    static void decode_deltas(BinaryReader& in, std::vector<T>& column, size_t count) {
+        column.resize(count);
+        std::int64_t previous = 0;
+        for (T& value : column) {
+            previous += in.svarint();
+            value = static_cast<T>(previous);
+        }
+    }
+
+    void seal() {
+        SealedChunk chunk;
+        chunk.count = static_cast<std::uint32_t>(open_.size());
+        auto [min_user, max_user] = std::minmax_element(open_.users.begin(), open_.users.end());
+        auto [min_book, max_book] = std::minmax_element(open_.books.begin(), open_.books.end());
+        auto [min_time, max_time] = std::minmax_element(open_.times.begin(), open_.times.end());
+        chunk.summary = {*min_user, *max_user, *min_book, *max_book, *min_time, *max_time};
+
+        BinaryWriter out(chunk.data);
+        encode_deltas(out, open_.users);
+        encode_deltas(out, open_.books);
+        encode_deltas(out, open_.times);
+        for (size_t i = 0; i < open_.ops.size(); i += 8) {
+            std::uint8_t bits = 0;
+            for (size_t bit = 0; bit < 8 && i + bit < open_.ops.size(); ++bit) {
+                bits |= static_cast<std::uint8_t>(open_.ops[i + bit] << bit);
+            }
+            out.u8(bits);
+        }
+        chunk.data.shrink_to_fit();
+
+        sealed_.push_back(std::move(chunk));
+        sealed_events_ += open_.size();
+        open_.clear();
+    }
+
+    static void decode(const SealedChunk& chunk, ChunkColumns& columns) {
+        BinaryReader in(chunk.data);
+        decode_deltas(in, columns.users, chunk.count);
+        decode_deltas(in, columns.books, chunk.count);
+        decode_deltas(in, columns.times, chunk.count);
+        columns.ops.resize(chunk.count);
+        for (size_t i = 0; i < chunk.count; i += 8) {
+            std::uint8_t bits = in.u8();
+            for (size_t bit = 0; bit < 8 && i + bit < chunk.count; ++bit) {
+                columns.ops[i + bit] = (bits >> bit) & 1;
+            }
+        }
+    }
+
+    void trim() {
+        while (!sealed_.empty() && size() - sealed_.front().count >= retention_) {
+            sealed_events_ -= sealed_.front().count;
+            dropped_ += sealed_.front().count;
+            sealed_.pop_front();
+        }
+    }
+
+    std::deque<SealedChunk> sealed_;
+    ChunkColumns open_;
+    size_t sealed_events_ = 0;
+    size_t retention_;
+    std::uint64_t dropped_ = 0;
+};
@@ -0,0 +1,578 @@
+#pragma once
+#include "library.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+
+
+// Bulk loading of book and patron files into a Library, one record per line:
+//
+//   CSV    books "id,name,author,genre", patrons "id,type,name,email"; fields
+//          may be double-quoted, with "" for a literal quote, and a first line
+//          starting with "id," is a header (as for catalog_compiler).
+//   JSONL  one flat object per line with the same keys, e.g.
+//          {"id": 7, "type": "student", "name": "Ann", "email": "ann@example.org"}
+//
+// The file is mapped, not read. A first pass counts the lines, so the book
+// table is sized once, and cuts the file into batches of whole lines. Worker
+// threads parse batches in parallel: fields are views into the mapping, and
+// only fields with quotes or escapes are copied. Authors and genres repeat
+// heavily, so each worker remembers the symbols it has already interned.
+// Parsed batches go to the library in file order through add_books() /
+// add_users(), one exclusive lock per batch, while later batches are still
+// being parsed; at most two batches per worker are held in memory.
+//
+// Malformed lines and records the library rejects (duplicate ids and the
+// like) are counted and skipped; the rest of the file is still imported.
+
+enum class ImportFormat {
+    BY_EXTENSION, // ".jsonl" and ".json" are JSONL, anything else CSV
+    CSV,
+    JSONL
+};
+
+struct ImportOptions {
+    ImportFormat format = ImportFormat::BY_EXTENSION;
+    unsigned threads = 0; // parser threads; 0 means one per hardware thread
+    size_t batch_lines = size_t{1} << 16;
+};
+
+// The file to import cannot be opened or mapped.
+class ImportException : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct ImportStats {
+    static constexpr size_t kMaxErrors = 10;
+
+    size_t imported = 0;
+    size_t rejected = 0;
+    std::vector<std::string> errors; // the first kMaxErrors, as "path:line: message"
+    std::chrono::microseconds elapsed{0};
+};
+
+
+namespace bulk_import_detail {
+
+constexpr size_t kMaxFields = 4;
+
+// Fields of one record; a field points into the file unless it had to be
+// unescaped, in which case it points into the matching scratch string.
+struct Fields {
+    std::array<std::string_view, kMaxFields> values{};
+    std::array<bool, kMaxFields> present{};
+    std::array<std::string, kMaxFields> scratch;
+};
+
+// Splits a CSV line into exactly kMaxFields fields.
+inline const char* split_csv(std::string_view line, Fields& fields) {
+    size_t count = 0;
+    size_t i = 0;
+    while (true) {
+        if (count == kMaxFields) {
+            return "expected 4 comma-separated fields";
+        }
+        if (i < line.size() && line[i] == '"') {
+            std::string& value = fields.scratch[count];
+            value.clear();
+            ++i;
+            size_t start = i;
+            bool escaped = false;
+            while (true) {
+                if (i == line.size()) {
+                    return "unterminated quoted field";
+                }
+                if (line[i] == '"') {
+                    if (i + 1 < line.size() && line[i + 1] == '"') {
+                        value.append(line.data() + start, i + 1 - start);
+                        i += 2;
+                        start = i;
+                        escaped = true;
+                        continue;
+                    }
+                    break;
+                }
+                ++i;
+            }
+            if (escaped) {
+                value.append(line.data() + start, i - start);
+                fields.values[count] = value;
+            } else {
+                fields.values[count] = line.substr(start, i - start);
+            }
+            ++i;
+            if (i < line.size() && line[i] != ',') {
+                return "unexpected text after a quoted field";
+            }
+        } else {
+            size_t end = std::min(line.find(',', i), line.size());
+            fields.values[count] = line.substr(i, end - i);
+            i = end;
+        }
+        fields.present[count++] = true;
+        if (i == line.size()) {
+            break;
+        }
+        ++i; // the comma
+    }
+    return count == kMaxFields ? nullptr : "expected 4 comma-separated fields";
+}
+
+inline void append_utf8(std::string& out, std::uint32_t code_point) {
+    if (code_point < 0x80) {
+        out.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
+inline bool parse_hex4(std::string_view text, size_t at, std::uint32_t& value) {
+    if (at + 4 > text.size()) {
+        return false;
+    }
+    auto [end, error] = std::from_chars(text.data() + at, text.data() + at + 4, value, 16);
+    return error == std::errc() && end == text.data() + at + 4;
+}
+
+// Reads the JSON string starting at text[i] == '"' and leaves i past its
+// closing quote. Escapes are decoded into scratch.
+inline const char* read_json_string(std::string_view text, size_t& i, std::string& scratch, std::string_view& value) {
+    size_t start = ++i;
+    while (i < text.size() && text[i] != '"' && text[i] != '\\') {
+        ++i;
+    }
+    if (i < text.size() && text[i] == '"') {
+        value = text.substr(start, i - start);
+        ++i;
+        return nullptr;
+    }
+    scratch.assign(text.data() + start, i - start);
+    while (i < text.size() && text[i] != '"') {
+        if (text[i] != '\\') {
+            scratch.push_back(text[i++]);
+            continue;
+        }
+        if (++i == text.size()) {
+            break;
+        }
+        char escape = text[i++];
+        switch (escape) {
+        case '"': case '\\': case '/': scratch.push_back(escape); break;
+        case 'b': scratch.push_back('\b'); break;
+        case 'f': scratch.push_back('\f'); break;
+        case 'n': scratch.push_back('\n'); break;
+        case 'r': scratch.push_back('\r'); break;
+        case 't': scratch.push_back('\t'); break;
+        case 'u': {
+            std::uint32_t code_point;
+            if (!parse_hex4(text, i, code_point)) {
+                return "bad \\u escape";
+            }
+            i += 4;
+            if (code_point >= 0xD800 && code_point < 0xDC00) {
+                std::uint32_t low;
+                if (text.substr(i, 2) != "\\u" || !parse_hex4(text, i + 2, low) || low < 0xDC00 || low >= 0xE000) {
+                    return "unpaired surrogate in \\u escape";
+                }
+                i += 6;
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+            } else if (code_point >= 0xDC00 && code_point < 0xE000) {
+                return "unpaired surrogate in \\u escape";
+            }
+            append_utf8(scratch, code_point);
+            break;
+        }
+        default: return "bad escape in string";
+        }
+    }
+    if (i == text.size()) {
+        return "unterminated string";
+    }
+    ++i;
+    value = scratch;
+    return nullptr;
+}
+
+inline void skip_space(std::string_view text, size_t& i) {
+    while (i < text.size() && (text[i] == ' ' || text[i] == '\t')) {
+        ++i;
+    }
+}
+
+// Parses a flat JSON object; values of the given keys land in the matching
+// fields (numbers as their text), other keys must have string or number values.
+inline const char* split_json(std::string_view line, const std::array<std::string_view, kMaxFields>& keys, Fields& fields) {
+    size_t i = 0;
+    skip_space(line, i);
+    if (i == line.size() || line[i] != '{') {
+        return "expected a JSON object";
+    }
+    ++i;
+    skip_space(line, i);
+    if (i < line.size() && line[i] == '}') {
+        ++i;
+    } else {
+        std::string key_scratch;
+        std::string ignored_scratch;
+        while (true) {
+            skip_space(line, i);
+            std::string_view key;
+            if (i == line.size() || line[i] != '"') {
+                return "expected a string key";
+            }
+            if (const char* error = read_json_string(line, i, key_scratch, key)) {
+                return error;
+            }
+            skip_space(line, i);
+            if (i == line.size() || line[i] != ':') {
+                return "expected ':' after a key";
+            }
+            ++i;
+            skip_space(line, i);
+            size_t field = std::find(keys.begin(), keys.end(), key) - keys.begin();
+            std::string& scratch = field < kMaxFields ? fields.scratch[field] : ignored_scratch;
+            std::string_view value;
+            if (i < line.size() && line[i] == '"') {
+                if (const char* error = read_json_string(line, i, scratch, value)) {
+                    return error;
+                }
+            } else {
+                size_t start = i;
+                while (i < line.size() && (line[i] == '-' || line[i] == '+' || line[i] == '.' || line[i] == 'e' || line[i] == 'E'
+                                           || (line[i] >= '0' && line[i] <= '9'))) {
+                    ++i;
+                }
+                if (i == start) {
+                    return "expected a string or number value";
+                }
+                value = line.substr(start, i - start);
+            }
+            if (field < kMaxFields) {
+                fields.values[field] = value;
+                fields.present[field] = true;
+            }
+            skip_space(line, i);
+            if (i < line.size() && line[i] == ',') {
+                ++i;
+                continue;
+            }
+            if (i < line.size() && line[i] == '}') {
+                ++i;
+                break;
+            }
+            return "expected ',' or '}'";
+        }
+    }
+    skip_space(line, i);
+    if (i != line.size()) {
+        return "unexpected text after the object";
+    }
+    for (size_t field = 0; field < kMaxFields; ++field) {
+        if (!fields.present[field]) {
+            return field == 0 ? "missing \"id\"" : "missing a field";
+        }
+    }
+    return nullptr;
+}
+
+inline const char* parse_id(std::string_view text, int& id) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), id);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        return "id is not an integer";
+    }
+    return nullptr;
+}
+
+struct BookRecords {
+    using Record = Book;
+    static constexpr std::array<std::string_view, kMaxFields> kKeys = {"id", "name", "author", "genre"};
+
+    // Interned authors and genres seen by this worker, keyed by the pool's
+    // copy of the text, so repeats skip the pool's lock.
+    std::unordered_map<std::string_view, Symbol> known_symbols;
+
+    Symbol intern_repeated(std::string_view text) {
+        auto it = known_symbols.find(text);
+        if (it != known_symbols.end()) {
+            return it->second;
+        }
+        Symbol symbol = string_pool().intern(text);
+        known_symbols.emplace(string_pool().str(symbol), symbol);
+        return symbol;
+    }
+
+    const char* build(const Fields& fields, std::vector<Book>& records) {
+        int id;
+        if (const char* error = parse_id(fields.values[0], id)) {
+            return error;
+        }
+        records.emplace_back(string_pool().intern(fields.values[1]), intern_repeated(fields.values[2]),
+                             intern_repeated(fields.values[3]), id);
+        return nullptr;
+    }
+
+    template <typename Duration>
+    static std::vector<LibraryError> add(Library<Duration>& library, const std::vector<Book>& records) {
+        return library.add_books(records);
+    }
+};
+
+struct UserRecords {
+    using Record = User;
+    static constexpr std::array<std::string_view, kMaxFields> kKeys = {"id", "type", "name", "email"};
+
+    const char* build(const Fields& fields, std::vector<User>& records) {
+        int id;
+        if (const char* error = parse_id(fields.values[0], id)) {
+            return error;
+        }
+        std::optional<UserType> type = user_type_from_name(fields.values[1]);
+        if (!type) {
+            return "type must be student, faculty or guest";
+        }
+        records.emplace_back(*type, fields.values[2], fields.values[3], id);
+        return nullptr;
+    }
+
+    template <typename Duration>
+    static std::vector<LibraryError> add(Library<Duration>& library, const std::vector<User>& records) {
+        return library.add_users(records);
+    }
+};
+
+template <typename Record>
+struct ParsedBatch {
+    std::vector<Record> records;
+    std::vector<size_t> line_numbers; // of records
+    std::vector<std::pair<size_t, const char*>> errors; // line number, message
+    bool ready = false;
+};
+
+// Byte ranges of batches of whole lines and the number of their first line.
+struct Batches {
+    std::vector<size_t> starts; // plus the file size at the end
+    std::vector<size_t> first_lines;
+    size_t lines = 0;
+};
+
+inline Batches cut_batches(const char* data, size_t size, size_t batch_lines) {
+    Batches batches;
+    batches.starts.push_back(0);
+    batches.first_lines.push_back(1);
+    size_t in_batch = 0;
+    for (const char* at = data; size > 0 && at < data + size;) {
+        const char* newline = static_cast<const char*>(std::memchr(at, '\n', static_cast<size_t>(data + size - at)));
+        at = newline ? newline + 1 : data + size;
+        ++batches.lines;
+        if (++in_batch == batch_lines && at < data + size) {
+            batches.starts.push_back(static_cast<size_t>(at - data));
+            batches.first_lines.push_back(batches.lines + 1);
+            in_batch = 0;
+        }
+    }
+    batches.starts.push_back(size);
+    return batches;
+}
+
+template <typename Records>
+void parse_batch(std::string_view text, size_t first_line, bool csv, Records& records,
+                 ParsedBatch<typename Records::Record>& batch) {
+    Fields fields;
+    size_t number = first_line;
+    for (size_t at = 0; at < text.size(); ++number) {
+        size_t end = std::min(text.find('\n', at), text.size());
+        std::string_view line = text.substr(at, end - at);
+        at = end + 1;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || (csv && number == 1 && line.substr(0, 3) == "id,")) {
+            continue;
+        }
+        fields.present.fill(false);
+        const char* error = csv ? split_csv(line, fields) : split_json(line, Records::kKeys, fields);
+        if (!error) {
+            error = records.build(fields, batch.records);
+        }
+        if (error) {
+            batch.errors.emplace_back(number, error);
+        } else {
+            batch.line_numbers.push_back(number);
+        }
+    }
+}
+
+inline bool is_jsonl_path(const std::string& path) {
+    auto ends_with = [&](std::string_view suffix) {
+        return path.size() >= suffix.size() && std::string_view(path).substr(path.size() - suffix.size()) == suffix;
+    };
+    return ends_with(".jsonl") || ends_with(".json");
+}
+
+// MappedFile reports failures as catalog errors; an import reports its own.
+inline MappedFile map_import_file(const std::string& path) {
+    try {
+        return MappedFile(path);
+    } catch (const CatalogFormatException&) {
+        throw ImportException("Cannot read import file " + path);
+    }
+}
+
+template <typename Records, typename Duration>
+ImportStats import_file(Library<Duration>& library, const std::string& path, const ImportOptions& options) {
+    using Record = typename Records::Record;
+    auto started = std::chrono::steady_clock::now();
+    ImportStats stats;
+    auto note = [&](size_t line, const std::string& message) {
+        ++stats.rejected;
+        if (stats.errors.size() < ImportStats::kMaxErrors) {
+            stats.errors.push_back(path + ":" + std::to_string(line) + ": " + message);
+        }
+    };
+
+    bool csv = options.format == ImportFormat::CSV
+               || (options.format == ImportFormat::BY_EXTENSION && !is_jsonl_path(path));
+    MappedFile file = map_import_file(path);
+    Batches cut = cut_batches(file.data(), file.size(), std::max<size_t>(options.batch_lines, 1));
+    if constexpr (std::is_same_v<Record, Book>) {
+        library.reserve_books(cut.lines);
+    }
+
+    size_t batch_count = cut.first_lines.size();
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, batch_count));
+    const size_t window = 2 * static_cast<size_t>(threads);
+
+    std::vector<ParsedBatch<Record>> parsed(batch_count);
+    std::mutex mutex;
+    std::condition_variable batch_parsed, batch_added;
+    size_t next_batch = 0, added_batches = 0;
+    bool stopping = false;
+    std::exception_ptr failure;
+
+    auto work = [&] {
+        Records records;
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                batch_added.wait(lock, [&] { return stopping || next_batch == batch_count || next_batch < added_batches + window; });
+                if (stopping || next_batch == batch_count) {
+                    return;
+                }
+                index = next_batch++;
+            }
+            try {
+                std::string_view text(file.data() + cut.starts[index], cut.starts[index + 1] - cut.starts[index]);
+                parse_batch(text, cut.first_lines[index], csv, records, parsed[index]);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!failure) failure = std::current_exception();
+                stopping = true;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                parsed[index].ready = true;
+            }
+            batch_parsed.notify_all();
+            batch_added.notify_all(); // wakes the other workers if stopping
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(work);
+    }
+
+    try {
+        for (size_t index = 0; index < batch_count; ++index) {
+            ParsedBatch<Record> batch;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                batch_parsed.wait(lock, [&] { return parsed[index].ready || failure; });
+                if (failure) {
+                    break;
+                }
+                batch = std::move(parsed[index]);
+            }
+            std::vector<LibraryError> results = Records::add(library, batch.records);
+            // Parse errors and rejected records are reported in line order.
+            auto error = batch.errors.begin();
+            for (size_t i = 0; i < results.size(); ++i) {
+                for (; error != batch.errors.end() && error->first < batch.line_numbers[i]; ++error) {
+                    note(error->first, error->second);
+                }
+                if (results[i] == LibraryError::NONE) {
+                    ++stats.imported;
+                } else {
+                    note(batch.line_numbers[i], error_message(results[i]));
+                }
+            }
+            for (; error != batch.errors.end(); ++error) {
+                note(error->first, error->second);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                added_batches = index + 1;
+            }
+            batch_added.notify_all();
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!failure) failure = std::current_exception();
+            stopping = true;
+        }
+        batch_added.notify_all();
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    stats.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+    return stats;
+}
+
+} // namespace bulk_import_detail
+
+
+// Imports the books of a CSV or JSONL file (see above). Throws
+// ImportException if the file cannot be read.
+template <typename Duration>
+ImportStats import_books(Library<Duration>& library, const std::string& path, const ImportOptions& options = {}) {
+    return bulk_import_detail::import_file<bulk_import_detail::BookRecords>(library, path, options);
+}
+
+// Imports the users of a CSV or JSONL file (see above). Throws
+// ImportException if the file cannot be read.
+template <typename Duration>
+ImportStats import_users(Library<Duration>& library, const std::string& path, const ImportOptions& options = {}) {
+    return bulk_import_detail::import_file<bulk_import_detail::UserRecords>(library, path, options);
+}
@@ -0,0 +1,78 @@
+// Offline tool: compiles a CSV catalog into the binary format that
+// Library::open_catalog maps at startup.
+//
+//   catalog_compiler <catalog.csv> <catalog.bin>
+//
+// Each CSV line is "id,name,author,genre"; fields may be double-quoted, with
+// "" for a literal quote. A first line starting with "id," is a header.
+#include "catalog_file.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+static bool split_csv_line(const std::string& line, std::vector<std::string>& fields) {
+    fields.clear();
+    std::string field;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                field += '"';
+                ++i;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                field += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.push_back(std::move(field));
+            field.clear();
+        } else if (c != '\r') {
+            field += c;
+        }
+    }
+    fields.push_back(std::move(field));
+    return !quoted;
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <catalog.csv> <catalog.bin>\n";
+        return 2;
+    }
+    std::ifstream input(argv[1]);
+    if (!input) {
+        std::cerr << "Cannot open " << argv[1] << "\n";
+        return 1;
+    }
+
+    CatalogWriter writer;
+    std::string line;
+    std::vector<std::string> fields;
+    size_t line_number = 0;
+    try {
+        while (std::getline(input, line)) {
+            ++line_number;
+            if (line.empty() || line == "\r" || (line_number == 1 && line.rfind("id,", 0) == 0)) {
+                continue;
+            }
+            if (!split_csv_line(line, fields) || fields.size() != 4) {
+                std::cerr << argv[1] << ":" << line_number << ": expected id,name,author,genre\n";
+                return 1;
+            }
+            writer.add(std::stoi(fields[0]), fields[1], fields[2], fields[3]);
+        }
+        writer.write(argv[2]);
+    } catch (const std::exception& e) {
+        std::cerr << argv[1] << ":" << line_number << ": " << e.what() << "\n";
+        return 1;
+    }
+    std::cout << "Compiled " << writer.book_count() << " books into " << argv[2] << "\n";
+    return 0;
+}
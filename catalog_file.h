@@ -0,0 +1,528 @@
+#pragma once
+#include "book.h"
+#include "string_pool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+class CatalogFormatException : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            throw CatalogFormatException("Cannot open catalog " + path);
+        }
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_, &size);
+        size_ = static_cast<size_t>(size.QuadPart);
+        if (size_ > 0) {
+            mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data_ = mapping_ ? static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            if (data_ == nullptr) {
+                close();
+                throw CatalogFormatException("Cannot map catalog " + path);
+            }
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw CatalogFormatException("Cannot open catalog " + path);
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw CatalogFormatException("Cannot stat catalog " + path);
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        if (size_ > 0) {
+            void* data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                throw CatalogFormatException("Cannot map catalog " + path);
+            }
+            data_ = static_cast<const char*>(data);
+        }
+        ::close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() { close(); }
+
+    const char* data() const { return data_; }
+
+    size_t size() const { return size_; }
+
+private:
+    void close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+        mapping_ = nullptr;
+#else
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+#endif
+        data_ = nullptr;
+    }
+
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+
+enum class CatalogAttribute {
+    AUTHOR,
+    GENRE,
+    NAME
+};
+
+
+// On-disk layout of a compiled catalog, version 1. All integers are
+// little-endian and every section starts at an 8-byte aligned offset, so the
+// file can be used in place once mapped.
+//
+//   CatalogHeader
+//   CatalogBookRow[book_count]          sorted by id
+//   u64[string_count + 1]               start of each string in the string data
+//   char[]                              string data, not NUL-terminated
+//   u32[string_count]                   string indexes in byte-wise sorted order
+//   3 x postings section                author, genre, name:
+//       u64 key_count
+//       CatalogPostingsKey[key_count]   sorted by string index
+//       i32[]                           book ids, sorted within each key
+namespace catalog_format {
+
+constexpr char kMagic[8] = {'L', 'I', 'B', 'C', 'A', 'T', '\0', '\x1a'};
+constexpr std::uint32_t kVersion = 1;
+
+struct CatalogHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint64_t file_size;
+    std::uint64_t book_count;
+    std::uint64_t string_count;
+    std::uint64_t books_offset;
+    std::uint64_t string_offsets_offset;
+    std::uint64_t string_data_offset;
+    std::uint64_t sorted_strings_offset;
+    std::uint64_t postings_offset[3]; // indexed by CatalogAttribute
+};
+
+struct CatalogBookRow {
+    std::int32_t id;
+    std::uint32_t name;
+    std::uint32_t author;
+    std::uint32_t genre;
+};
+
+struct CatalogPostingsKey {
+    std::uint32_t string;
+    std::uint32_t count;
+    std::uint64_t first; // index of the first id in the section's id array
+};
+
+static_assert(sizeof(CatalogHeader) == 96, "catalog header layout changed");
+static_assert(sizeof(CatalogBookRow) == 16, "catalog book row layout changed");
+static_assert(sizeof(CatalogPostingsKey) == 16, "catalog postings key layout changed");
+
+} // namespace catalog_format
+
+
+// Sorted book ids stored in a catalog.
+struct CatalogIds {
+    const std::int32_t* first = nullptr;
+    size_t count = 0;
+
+    const std::int32_t* begin() const { return first; }
+    const std::int32_t* end() const { return first + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+};
+
+
+// A compiled catalog mapped into memory. Opening validates the header, the
+// section bounds and every index stored in the file: string offsets, book
+// rows, and each postings id, which must name a book row with that key. That
+// takes time linear in the catalog (plus a row search per postings id), and
+// afterwards lookups work directly on the mapped data.
+//
+// The catalog is also a StringSegment: its strings are served to the global
+// string pool without copying, and books read from it carry symbols that
+// point into the mapping.
+class CatalogFile : public StringSegment {
+public:
+    // Opening the same file again returns the already mapped catalog.
+    static std::shared_ptr<const CatalogFile> open(const std::string& path) {
+        static std::mutex cache_mutex;
+        static std::map<std::string, std::shared_ptr<const CatalogFile>> cache;
+        std::string key = std::filesystem::weakly_canonical(path).string();
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            return it->second;
+        }
+        std::shared_ptr<CatalogFile> catalog(new CatalogFile(path));
+        catalog->segment_ = string_pool().attach_segment(catalog);
+        cache.emplace(key, catalog);
+        return catalog;
+    }
+
+    size_t book_count() const { return header_->book_count; }
+
+    size_t string_count() const override { return header_->string_count; }
+
+    std::string_view string_at(std::uint32_t index) const override {
+        return std::string_view(string_data_ + string_offsets_[index],
+                                string_offsets_[index + 1] - string_offsets_[index]);
+    }
+
+    std::optional<std::uint32_t> find_string(std::string_view text) const override {
+        const std::uint32_t* end = sorted_strings_ + header_->string_count;
+        const std::uint32_t* it = std::lower_bound(sorted_strings_, end, text,
+            [this](std::uint32_t index, std::string_view value) { return string_at(index) < value; });
+        if (it == end || string_at(*it) != text) {
+            return std::nullopt;
+        }
+        return *it;
+    }
+
+    bool contains(int book_id) const { return find_row(book_id) != nullptr; }
+
+    // Throws std::out_of_range if the catalog has no such book.
+    Book get(int book_id) const {
+        const catalog_format::CatalogBookRow* row = find_row(book_id);
+        if (row == nullptr) {
+            throw std::out_of_range("Book " + std::to_string(book_id) + " is not in the catalog");
+        }
+        return book_from_row(*row);
+    }
+
+    int max_book_id() const {
+        return header_->book_count == 0 ? -1 : books_[header_->book_count - 1].id;
+    }
+
+    CatalogIds postings(CatalogAttribute attribute, std::string_view key) const {
+        auto index = find_string(key);
+        if (!index) {
+            return {};
+        }
+        const Postings& section = postings_[static_cast<int>(attribute)];
+        const auto* end = section.keys + section.key_count;
+        const auto* it = std::lower_bound(section.keys, end, *index,
+            [](const catalog_format::CatalogPostingsKey& entry, std::uint32_t value) { return entry.string < value; });
+        if (it == end || it->string != *index) {
+            return {};
+        }
+        return {section.ids + it->first, it->count};
+    }
+
+    // visit(key_text, ids) for every distinct author, genre or name
+    template <typename F>
+    void for_each_key(CatalogAttribute attribute, F&& visit) const {
+        const Postings& section = postings_[static_cast<int>(attribute)];
+        for (std::uint64_t i = 0; i < section.key_count; ++i) {
+            const auto& entry = section.keys[i];
+            visit(string_at(entry.string), CatalogIds{section.ids + entry.first, entry.count});
+        }
+    }
+
+    // Books in id order.
+    template <typename F>
+    void for_each_book(F&& visit) const {
+        for (std::uint64_t i = 0; i < header_->book_count; ++i) {
+            visit(book_from_row(books_[i]));
+        }
+    }
+
+    // Ids of the books in order, without materializing them.
+    template <typename F>
+    void for_each_book_id(F&& visit) const {
+        for (std::uint64_t i = 0; i < header_->book_count; ++i) {
+            visit(static_cast<int>(books_[i].id));
+        }
+    }
+
+private:
+    using Header = catalog_format::CatalogHeader;
+
+    struct Postings {
+        std::uint64_t key_count = 0;
+        const catalog_format::CatalogPostingsKey* keys = nullptr;
+        const std::int32_t* ids = nullptr;
+    };
+
+    explicit CatalogFile(const std::string& path) : file_(path) {
+        const char* base = file_.data();
+        if (file_.size() < sizeof(Header)) {
+            throw CatalogFormatException("Catalog is truncated: " + path);
+        }
+        header_ = reinterpret_cast<const Header*>(base);
+        if (std::memcmp(header_->magic, catalog_format::kMagic, sizeof(catalog_format::kMagic)) != 0) {
+            throw CatalogFormatException("Not a library catalog: " + path);
+        }
+        if (header_->version != catalog_format::kVersion) {
+            throw CatalogFormatException("Unsupported catalog version " + std::to_string(header_->version) + ": " + path);
+        }
+        if (header_->file_size != file_.size()) {
+            throw CatalogFormatException("Catalog size does not match its header: " + path);
+        }
+        if (header_->string_count > StringPool::kMaxSegmentStrings) {
+            throw CatalogFormatException("Catalog has too many strings: " + path);
+        }
+        books_ = section<catalog_format::CatalogBookRow>(header_->books_offset, header_->book_count);
+        string_offsets_ = section<std::uint64_t>(header_->string_offsets_offset, header_->string_count + 1);
+        string_data_ = section<char>(header_->string_data_offset, string_offsets_[header_->string_count]);
+        sorted_strings_ = section<std::uint32_t>(header_->sorted_strings_offset, header_->string_count);
+        for (int attribute = 0; attribute < 3; ++attribute) {
+            std::uint64_t offset = header_->postings_offset[attribute];
+            Postings& postings = postings_[attribute];
+            postings.key_count = *section<std::uint64_t>(offset, 1);
+            postings.keys = section<catalog_format::CatalogPostingsKey>(offset + 8, postings.key_count);
+            postings.ids = section<std::int32_t>(offset + 8 + postings.key_count * sizeof(catalog_format::CatalogPostingsKey),
+                                                 header_->book_count);
+        }
+        validate(path);
+    }
+
+    // Rejects indexes that would read outside the mapping or break the binary
+    // searches: string offsets must not decrease, rows must be in ascending id
+    // order, rows and postings must point at strings that exist, and each
+    // key's ids must be ascending ids of book rows that have that key.
+    void validate(const std::string& path) const {
+        std::uint64_t string_count = header_->string_count;
+        for (std::uint64_t i = 0; i < string_count; ++i) {
+            if (string_offsets_[i] > string_offsets_[i + 1] || sorted_strings_[i] >= string_count) {
+                throw CatalogFormatException("Catalog string table is corrupt: " + path);
+            }
+        }
+        for (std::uint64_t i = 0; i < header_->book_count; ++i) {
+            const auto& row = books_[i];
+            if (row.id < 0 || (i > 0 && row.id <= books_[i - 1].id) || row.name >= string_count
+                || row.author >= string_count || row.genre >= string_count) {
+                throw CatalogFormatException("Catalog book row " + std::to_string(i) + " is corrupt: " + path);
+            }
+        }
+        // Indexed by CatalogAttribute, as postings_ is.
+        constexpr std::uint32_t catalog_format::CatalogBookRow::*kKeyOf[3] = {
+            &catalog_format::CatalogBookRow::author, &catalog_format::CatalogBookRow::genre,
+            &catalog_format::CatalogBookRow::name};
+        for (int attribute = 0; attribute < 3; ++attribute) {
+            const Postings& postings = postings_[attribute];
+            for (std::uint64_t i = 0; i < postings.key_count; ++i) {
+                const auto& key = postings.keys[i];
+                if (key.string >= string_count || key.first > header_->book_count
+                    || key.count > header_->book_count - key.first) {
+                    throw CatalogFormatException("Catalog postings are corrupt: " + path);
+                }
+                const std::int32_t* ids = postings.ids + key.first;
+                for (std::uint32_t j = 0; j < key.count; ++j) {
+                    const catalog_format::CatalogBookRow* row = find_row(ids[j]);
+                    if ((j > 0 && ids[j] <= ids[j - 1]) || row == nullptr || row->*kKeyOf[attribute] != key.string) {
+                        throw CatalogFormatException("Catalog postings do not match the book rows: " + path);
+                    }
+                }
+            }
+        }
+    }
+
+    // Bounds-checked pointer to count items at offset.
+    template <typename T>
+    const T* section(std::uint64_t offset, std::uint64_t count) const {
+        if (offset % alignof(T) != 0 || offset > file_.size()
+            || count > (file_.size() - offset) / sizeof(T)) {
+            throw CatalogFormatException("Catalog section out of bounds");
+        }
+        return reinterpret_cast<const T*>(file_.data() + offset);
+    }
+
+    const catalog_format::CatalogBookRow* find_row(int book_id) const {
+        const auto* end = books_ + header_->book_count;
+        const auto* it = std::lower_bound(books_, end, book_id,
+            [](const catalog_format::CatalogBookRow& row, int id) { return row.id < id; });
+        return (it != end && it->id == book_id) ? it : nullptr;
+    }
+
+    Book book_from_row(const catalog_format::CatalogBookRow& row) const {
+        return Book(StringPool::segment_symbol(segment_, row.name),
+                    StringPool::segment_symbol(segment_, row.author),
+                    StringPool::segment_symbol(segment_, row.genre), row.id);
+    }
+
+    MappedFile file_;
+    const Header* header_ = nullptr;
+    const catalog_format::CatalogBookRow* books_ = nullptr;
+    const std::uint64_t* string_offsets_ = nullptr;
+    const char* string_data_ = nullptr;
+    const std::uint32_t* sorted_strings_ = nullptr;
+    Postings postings_[3];
+    std::uint32_t segment_ = 0;
+};
+
+
+// Builds a catalog file from books added in any order.
+class CatalogWriter {
+public:
+    void add(int id, std::string_view name, std::string_view author, std::string_view genre) {
+        if (id < 0) {
+            throw CatalogFormatException("Book ID must be non-negative: " + std::to_string(id));
+        }
+        rows_.push_back({id, intern(name), intern(author), intern(genre)});
+    }
+
+    size_t book_count() const { return rows_.size(); }
+
+    void write(const std::string& path) {
+        using namespace catalog_format;
+        std::sort(rows_.begin(), rows_.end(), [](const CatalogBookRow& a, const CatalogBookRow& b) { return a.id < b.id; });
+        for (size_t i = 1; i < rows_.size(); ++i) {
+            if (rows_[i].id == rows_[i - 1].id) {
+                throw CatalogFormatException("Duplicate book ID " + std::to_string(rows_[i].id));
+            }
+        }
+
+        std::string out(sizeof(CatalogHeader), '\0');
+        CatalogHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.book_count = rows_.size();
+        header.string_count = strings_.size();
+
+        header.books_offset = append(out, rows_.data(), rows_.size());
+
+        std::vector<std::uint64_t> offsets;
+        offsets.reserve(strings_.size() + 1);
+        std::uint64_t position = 0;
+        for (const std::string& text : strings_) {
+            offsets.push_back(position);
+            position += text.size();
+        }
+        offsets.push_back(position);
+        header.string_offsets_offset = append(out, offsets.data(), offsets.size());
+        header.string_data_offset = align(out);
+        for (const std::string& text : strings_) {
+            out += text;
+        }
+
+        std::vector<std::uint32_t> sorted(strings_.size());
+        for (std::uint32_t i = 0; i < sorted.size(); ++i) {
+            sorted[i] = i;
+        }
+        std::sort(sorted.begin(), sorted.end(), [this](std::uint32_t a, std::uint32_t b) { return strings_[a] < strings_[b]; });
+        header.sorted_strings_offset = append(out, sorted.data(), sorted.size());
+
+        header.postings_offset[static_cast<int>(CatalogAttribute::AUTHOR)] = append_postings(out, &CatalogBookRow::author);
+        header.postings_offset[static_cast<int>(CatalogAttribute::GENRE)] = append_postings(out, &CatalogBookRow::genre);
+        header.postings_offset[static_cast<int>(CatalogAttribute::NAME)] = append_postings(out, &CatalogBookRow::name);
+
+        align(out);
+        header.file_size = out.size();
+        std::memcpy(out.data(), &header, sizeof(header));
+
+        std::string tmp_path = path + ".tmp";
+        std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+        if (file == nullptr) {
+            throw CatalogFormatException("Cannot create " + tmp_path);
+        }
+        bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+        written = std::fclose(file) == 0 && written;
+        if (!written) {
+            throw CatalogFormatException("Cannot write " + tmp_path);
+        }
+        std::filesystem::rename(tmp_path, path);
+    }
+
+private:
+    std::uint32_t intern(std::string_view text) {
+        auto it = string_index_.find(text);
+        if (it != string_index_.end()) {
+            return it->second;
+        }
+        strings_.emplace_back(text);
+        auto index = static_cast<std::uint32_t>(strings_.size() - 1);
+        string_index_.emplace(strings_.back(), index);
+        return index;
+    }
+
+    static std::uint64_t align(std::string& out) {
+        out.resize((out.size() + 7) / 8 * 8, '\0');
+        return out.size();
+    }
+
+    template <typename T>
+    static std::uint64_t append(std::string& out, const T* items, size_t count) {
+        std::uint64_t offset = align(out);
+        out.append(reinterpret_cast<const char*>(items), count * sizeof(T));
+        return offset;
+    }
+
+    // rows_ is sorted by id, so a stable sort by key leaves each key's ids sorted.
+    std::uint64_t append_postings(std::string& out, std::uint32_t catalog_format::CatalogBookRow::*key) {
+        std::vector<catalog_format::CatalogBookRow> by_key(rows_);
+        std::stable_sort(by_key.begin(), by_key.end(),
+            [key](const auto& a, const auto& b) { return a.*key < b.*key; });
+        std::vector<catalog_format::CatalogPostingsKey> keys;
+        std::vector<std::int32_t> ids;
+        ids.reserve(by_key.size());
+        for (const auto& row : by_key) {
+            if (keys.empty() || keys.back().string != row.*key) {
+                keys.push_back({row.*key, 0, ids.size()});
+            }
+            ++keys.back().count;
+            ids.push_back(row.id);
+        }
+        std::uint64_t key_count = keys.size();
+        std::uint64_t offset = append(out, &key_count, 1);
+        append(out, keys.data(), keys.size());
+        append(out, ids.data(), ids.size());
+        return offset;
+    }
+
+    std::vector<catalog_format::CatalogBookRow> rows_;
+    std::deque<std::string> strings_; // stable, string_index_ points into it
+    std::unordered_map<std::string_view, std::uint32_t> string_index_;
+};
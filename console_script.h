@@ -0,0 +1,161 @@
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Building blocks of LibraryConsole::run_script(): a line reader and an
+// output buffer that move data in large blocks, and the command tokenizer.
+
+// Reads lines from a FILE in blocks of kBlockSize; a line is valid until the
+// next call. The final line needs no newline, and "\r\n" endings are accepted.
+class ScriptReader {
+public:
+    static constexpr size_t kBlockSize = size_t{1} << 20;
+
+    explicit ScriptReader(std::FILE* file) : file_(file) {}
+
+    bool next_line(std::string_view& line) {
+        while (true) {
+            const char* begin = buffer_.data() + position_;
+            const char* newline = static_cast<const char*>(std::memchr(begin, '\n', buffer_.size() - position_));
+            if (newline || (at_eof_ && position_ < buffer_.size())) {
+                size_t end = newline ? static_cast<size_t>(newline - buffer_.data()) : buffer_.size();
+                line = std::string_view(begin, end - position_);
+                position_ = newline ? end + 1 : end;
+                if (!line.empty() && line.back() == '\r') {
+                    line.remove_suffix(1);
+                }
+                return true;
+            }
+            if (at_eof_) {
+                return false;
+            }
+            // Keep the partial line and append the next block after it.
+            buffer_.erase(0, position_);
+            position_ = 0;
+            size_t kept = buffer_.size();
+            buffer_.resize(kept + kBlockSize);
+            size_t read = std::fread(&buffer_[kept], 1, kBlockSize, file_);
+            buffer_.resize(kept + read);
+            at_eof_ = read < kBlockSize;
+        }
+    }
+
+private:
+    std::FILE* file_;
+    std::string buffer_;
+    size_t position_ = 0;
+    bool at_eof_ = false;
+};
+
+
+// Collects output and writes it to a FILE in blocks of about kBlockSize and
+// on flush(), instead of once per line.
+class ScriptOutput {
+public:
+    static constexpr size_t kBlockSize = size_t{1} << 20;
+
+    explicit ScriptOutput(std::FILE* file) : file_(file) { buffer_.reserve(kBlockSize + 4096); }
+
+    ScriptOutput(const ScriptOutput&) = delete;
+    ScriptOutput& operator=(const ScriptOutput&) = delete;
+
+    ~ScriptOutput() { flush(); }
+
+    ScriptOutput& operator<<(std::string_view text) {
+        buffer_.append(text);
+        return spill();
+    }
+
+    ScriptOutput& operator<<(char c) {
+        buffer_.push_back(c);
+        return spill();
+    }
+
+    ScriptOutput& operator<<(long long value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer_.append(digits, static_cast<size_t>(result.ptr - digits));
+        return spill();
+    }
+
+    ScriptOutput& operator<<(int value) { return *this << static_cast<long long>(value); }
+    ScriptOutput& operator<<(size_t value) { return *this << static_cast<long long>(value); }
+
+    void flush() {
+        std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+        std::fflush(file_);
+        buffer_.clear();
+    }
+
+private:
+    ScriptOutput& spill() {
+        if (buffer_.size() >= kBlockSize) {
+            std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+            buffer_.clear();
+        }
+        return *this;
+    }
+
+    std::FILE* file_;
+    std::string buffer_;
+};
+
+
+// Splits a command line into space-separated words. A word may be
+// double-quoted to hold spaces, with "" for a literal quote; such words are
+// unescaped into scratch, which must outlive the words. Returns false on an
+// unterminated quote.
+inline bool split_command(std::string_view line, std::vector<std::string_view>& words, std::deque<std::string>& scratch) {
+    words.clear();
+    size_t quoted = 0;
+    size_t i = 0;
+    while (true) {
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) {
+            ++i;
+        }
+        if (i == line.size()) {
+            return true;
+        }
+        if (line[i] != '"') {
+            size_t start = i;
+            while (i < line.size() && line[i] != ' ' && line[i] != '\t') {
+                ++i;
+            }
+            words.push_back(line.substr(start, i - start));
+            continue;
+        }
+        if (scratch.size() == quoted) {
+            scratch.emplace_back();
+        }
+        std::string& word = scratch[quoted++];
+        word.clear();
+        for (++i;; ++i) {
+            if (i == line.size()) {
+                return false;
+            }
+            if (line[i] == '"') {
+                if (i + 1 < line.size() && line[i + 1] == '"') {
+                    word.push_back('"');
+                    ++i;
+                    continue;
+                }
+                ++i;
+                break;
+            }
+            word.push_back(line[i]);
+        }
+        words.push_back(word);
+    }
+}
+
+inline bool parse_int(std::string_view text, int& value) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size();
+}
@@ -0,0 +1,217 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+
+
+// Patrons waiting for books that are out. Each book with holds has one FIFO
+// queue per priority level (0 is served first), stored as singly linked lists
+// of 16-byte nodes in one pooled vector; freed nodes are reused, so millions of
+// holds cost little more than the nodes themselves. Serving the next holder
+// looks at the heads only. Finding one user's hold walks the book's queues,
+// which stay short for all but the most wanted books.
+//
+// Holds expire: front() drops expired holds as they reach the head of their
+// queue, and position() and count() skip them until then; add() and remove()
+// drop the user's own expired hold when they meet it. Not thread-safe; Library
+// guards it with holds_mutex_.
+class HoldQueues {
+public:
+    using time_point = std::chrono::system_clock::time_point;
+
+    static constexpr int kNoHolder = -1;
+    static constexpr size_t kPriorities = 3;
+
+    explicit HoldQueues(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : nodes_(resource), queues_(resource) {}
+
+    size_t size() const { return size_; }
+
+    bool has_holds(int book_id) const { return queues_.count(book_id) != 0; }
+
+    // False if the user already holds a hold on the book that is live at
+    // `now`; an expired one is dropped and the user joins the back of the
+    // queue again. Precondition: priority < kPriorities.
+    bool add(int book_id, int user_id, size_t priority, time_point expires, time_point now) {
+        auto it = queues_.try_emplace(book_id).first;
+        Position existing = find(it->second, user_id);
+        if (existing.node != kNone) {
+            if (nodes_[existing.node].expires > now) {
+                return false;
+            }
+            if (unlink(it, existing)) {
+                it = queues_.try_emplace(book_id).first;
+            }
+        }
+        Queue& queue = it->second;
+        std::uint32_t node = allocate();
+        nodes_[node] = {user_id, kNone, expires};
+        if (queue.tail[priority] == kNone) {
+            queue.head[priority] = node;
+        } else {
+            nodes_[queue.tail[priority]].next = node;
+        }
+        queue.tail[priority] = node;
+        ++queue.count;
+        ++size_;
+        return true;
+    }
+
+    // False if the user holds no hold on the book that is live at `now`; an
+    // expired one is dropped all the same.
+    bool remove(int book_id, int user_id, time_point now) {
+        auto it = queues_.find(book_id);
+        if (it == queues_.end()) {
+            return false;
+        }
+        Position position = find(it->second, user_id);
+        if (position.node == kNone) {
+            return false;
+        }
+        bool live = nodes_[position.node].expires > now;
+        unlink(it, position);
+        return live;
+    }
+
+    // 1 for the holder served next, 0 if the user holds no hold on the book
+    // that is live at `now`.
+    size_t position(int book_id, int user_id, time_point now) const {
+        auto it = queues_.find(book_id);
+        if (it == queues_.end()) {
+            return 0;
+        }
+        size_t place = 1;
+        for (size_t priority = 0; priority < kPriorities; ++priority) {
+            for (std::uint32_t node = it->second.head[priority]; node != kNone; node = nodes_[node].next) {
+                if (nodes_[node].expires <= now) {
+                    continue;
+                }
+                if (nodes_[node].user_id == user_id) {
+                    return place;
+                }
+                ++place;
+            }
+        }
+        return 0;
+    }
+
+    // The holds on the book that are live at `now`.
+    size_t count(int book_id, time_point now) const {
+        auto it = queues_.find(book_id);
+        if (it == queues_.end()) {
+            return 0;
+        }
+        size_t live = 0;
+        for (size_t priority = 0; priority < kPriorities; ++priority) {
+            for (std::uint32_t node = it->second.head[priority]; node != kNone; node = nodes_[node].next) {
+                live += nodes_[node].expires > now;
+            }
+        }
+        return live;
+    }
+
+    // The holder served next, or kNoHolder; holds that expired by `now` are
+    // dropped on the way.
+    int front(int book_id, time_point now) {
+        auto it = queues_.find(book_id);
+        while (it != queues_.end()) {
+            size_t priority = 0;
+            while (it->second.head[priority] == kNone) {
+                ++priority; // a queue in the map is never empty
+            }
+            const Node& node = nodes_[it->second.head[priority]];
+            if (node.expires > now) {
+                return node.user_id;
+            }
+            Position head{priority, it->second.head[priority], kNone};
+            it = unlink(it, head) ? queues_.end() : it;
+        }
+        return kNoHolder;
+    }
+
+    // Precondition: front() just returned a holder of this book.
+    void pop_front(int book_id) {
+        auto it = queues_.find(book_id);
+        size_t priority = 0;
+        while (it->second.head[priority] == kNone) {
+            ++priority;
+        }
+        unlink(it, {priority, it->second.head[priority], kNone});
+    }
+
+private:
+    static constexpr std::uint32_t kNone = std::numeric_limits<std::uint32_t>::max();
+
+    struct Node {
+        int user_id;
+        std::uint32_t next; // in its queue, or in the free list
+        time_point expires;
+    };
+
+    struct Queue {
+        std::uint32_t head[kPriorities] = {kNone, kNone, kNone};
+        std::uint32_t tail[kPriorities] = {kNone, kNone, kNone};
+        std::uint32_t count = 0;
+    };
+
+    using QueueMap = std::pmr::unordered_map<int, Queue>;
+
+    struct Position {
+        size_t priority;
+        std::uint32_t node;
+        std::uint32_t previous; // kNone at the head
+    };
+
+    Position find(const Queue& queue, int user_id) const {
+        for (size_t priority = 0; priority < kPriorities; ++priority) {
+            std::uint32_t previous = kNone;
+            for (std::uint32_t node = queue.head[priority]; node != kNone; previous = node, node = nodes_[node].next) {
+                if (nodes_[node].user_id == user_id) {
+                    return {priority, node, previous};
+                }
+            }
+        }
+        return {0, kNone, kNone};
+    }
+
+    // Returns true if that was the book's last hold and its queue is gone.
+    bool unlink(QueueMap::iterator it, Position position) {
+        Queue& queue = it->second;
+        std::uint32_t next = nodes_[position.node].next;
+        if (position.previous == kNone) {
+            queue.head[position.priority] = next;
+        } else {
+            nodes_[position.previous].next = next;
+        }
+        if (queue.tail[position.priority] == position.node) {
+            queue.tail[position.priority] = position.previous;
+        }
+        nodes_[position.node].next = free_;
+        free_ = position.node;
+        --size_;
+        if (--queue.count == 0) {
+            queues_.erase(it);
+            return true;
+        }
+        return false;
+    }
+
+    std::uint32_t allocate() {
+        if (free_ != kNone) {
+            std::uint32_t node = free_;
+            free_ = nodes_[node].next;
+            return node;
+        }
+        nodes_.emplace_back();
+        return static_cast<std::uint32_t>(nodes_.size() - 1);
+    }
+
+    std::pmr::vector<Node> nodes_;
+    QueueMap queues_; // only books with holds
+    std::uint32_t free_ = kNone;
+    size_t size_ = 0;
+};
@@ -1,24 +1,175 @@
 #pragma once
 #include "users.h"
+#include "user_store.h"
 #include "book.h"
+#include "book_store.h"
+#include "catalog_file.h"
+#include "write_ahead_log.h"
+#include "borrow_history.h"
+#include "text_index.h"
+#include "book_query.h"
+#include "posting_list.h"
+#include "library_metrics.h"
+#include "hold_queues.h"
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <unordered_set>
 #include <optional>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
 #include <deque>
+#include <functional>
+#include <limits>
 #include <set>
 
-enum class BorrowOperationType {
-    BORROW,
-    RETURN
-};
-
 class IdGenerator {
 public:
     IdGenerator() : current_id_(0) {}
-    int get_next_id() { return current_id_++; }
+    int get_next_id() { return current_id_.fetch_add(1); }
+    int peek_next_id() const { return current_id_.load(); }
+    // Makes sure later ids never collide with an id that was assigned elsewhere.
+    void reserve(int id) {
+        int current = current_id_.load();
+        while (current <= id && !current_id_.compare_exchange_weak(current, id + 1)) {}
+    }
 private:
-    int current_id_;
+    std::atomic<int> current_id_;
+};
+
+
+// Fixed set of mutexes guarding the rows of a table by id. Each one sits on its
+// own cache line, so threads working on neighbouring ids don't slow each other
+// down. lock()/unlock() take the whole table, always in the same order.
+class LockShards {
+public:
+    static constexpr size_t kCount = 64;
+
+    std::mutex& of(int id) { return shards_[index_of(id)].mutex; }
+
+    // Sets of shards are bitmasks, one bit per shard.
+    static std::uint64_t mask_of(int id) { return std::uint64_t{1} << index_of(id); }
+
+    void lock(std::uint64_t mask) {
+        for (; mask != 0; mask &= mask - 1) {
+            shards_[count_trailing_zeros(mask)].mutex.lock();
+        }
+    }
+
+    void unlock(std::uint64_t mask) {
+        for (; mask != 0; mask &= mask - 1) {
+            shards_[count_trailing_zeros(mask)].mutex.unlock();
+        }
+    }
+
+    void lock() {
+        for (auto& shard : shards_) {
+            shard.mutex.lock();
+        }
+    }
+
+    void unlock() {
+        for (auto& shard : shards_) {
+            shard.mutex.unlock();
+        }
+    }
+
+private:
+    static_assert(kCount == 64, "shard sets are 64-bit masks");
+
+    static size_t index_of(int id) { return static_cast<unsigned>(id) % kCount; }
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+    };
+    std::array<Shard, kCount> shards_;
+};
+
+
+// Holds a set of shards, locked in index order, for its lifetime.
+class ShardSetLock {
+public:
+    ShardSetLock(LockShards& shards, std::uint64_t mask) : shards_(shards), mask_(mask) {
+        shards_.lock(mask_);
+    }
+    ~ShardSetLock() { shards_.unlock(mask_); }
+
+    ShardSetLock(const ShardSetLock&) = delete;
+    ShardSetLock& operator=(const ShardSetLock&) = delete;
+
+private:
+    LockShards& shards_;
+    std::uint64_t mask_;
+};
+
+
+// Outcome of a Library operation that reports failures as values (the try_
+// methods and the batch calls). Each code corresponds to one of the
+// LibraryOperationException messages.
+enum class LibraryError : std::uint8_t {
+    NONE,
+    USER_NOT_FOUND,
+    BOOK_NOT_FOUND,
+    BORROW_LIMIT_REACHED,
+    BOOK_NOT_AVAILABLE,
+    BOOK_NOT_BORROWED,
+    OWNER_NOT_FOUND,
+    USER_ALREADY_EXISTS,
+    BOOK_ALREADY_EXISTS,
+    NEGATIVE_BOOK_ID,
+    NEGATIVE_USER_ID,
+    USER_HAS_BORROWED_BOOKS,
+    USER_HAS_PENALTIES,
+    BOOK_IS_BORROWED,
+    NEGATIVE_PENALTY,
+    BOOK_IS_AVAILABLE,
+    HOLD_ALREADY_PLACED,
+    HOLD_NOT_FOUND
+};
+
+static_assert(static_cast<size_t>(LibraryError::HOLD_NOT_FOUND) < MetricsRecorder::kMaxResults,
+              "every LibraryError needs its own metrics counter");
+
+inline const char* error_message(LibraryError error) {
+    switch (error) {
+    case LibraryError::NONE: return "OK";
+    case LibraryError::USER_NOT_FOUND: return "User ID not found";
+    case LibraryError::BOOK_NOT_FOUND: return "Book ID not found";
+    case LibraryError::BORROW_LIMIT_REACHED: return "User has reached borrow limit";
+    case LibraryError::BOOK_NOT_AVAILABLE: return "Book is not available";
+    case LibraryError::BOOK_NOT_BORROWED: return "Book was not borrowed";
+    case LibraryError::OWNER_NOT_FOUND: return "User not found for borrowed book";
+    case LibraryError::USER_ALREADY_EXISTS: return "User with this ID already exists";
+    case LibraryError::BOOK_ALREADY_EXISTS: return "Book with this ID already exists";
+    case LibraryError::NEGATIVE_BOOK_ID: return "Book ID must be non-negative";
+    case LibraryError::NEGATIVE_USER_ID: return "User ID must be non-negative";
+    case LibraryError::USER_HAS_BORROWED_BOOKS: return "User has borrowed books";
+    case LibraryError::USER_HAS_PENALTIES: return "User has unpaid penalties";
+    case LibraryError::BOOK_IS_BORROWED: return "Book is borrowed";
+    case LibraryError::NEGATIVE_PENALTY: return "Penalty amount cannot be negative";
+    case LibraryError::BOOK_IS_AVAILABLE: return "Book is available";
+    case LibraryError::HOLD_ALREADY_PLACED: return "User already holds or has this book";
+    case LibraryError::HOLD_NOT_FOUND: return "User has no hold on this book";
+    }
+    return "Unknown error";
+}
+
+
+struct ReturnResult {
+    LibraryError error;
+    int penalty; // 0 unless the book came back late
+
+    bool ok() const { return error == LibraryError::NONE; }
+};
+
+
+// A book became available to everyone (user_id is BookStore::kNoOwner), or
+// was lent to user_id, the holder next in line, as it came back.
+struct AvailabilityEvent {
+    int book_id;
+    int user_id;
 };
 
 
@@ -35,213 +186,838 @@ private:
     std::string message_;
 };
 
+template <typename Duration>
+class LibraryPersistence;
+
+// Library is safe to share between threads. Structural changes (adding or
+// removing books and users, opening a catalog, checkpoints) take tables_mutex_
+// exclusively; everything else shares it and then locks only the rows it
+// touches: borrow_book and return_book lock one user shard and one book shard,
+// so desks working on different books and users run in parallel. Borrowers
+// racing for the same book are decided by BookStore::try_claim before any book
+// lock is taken, so the losers fail without waiting.
+//
+// Locks are always taken in this order, which keeps them deadlock-free:
+// tables_mutex_, user shard(s), book shard(s), holds_mutex_, history_mutex_.
+// Callbacks of the visitors run with some of these held and must not call back
+// into the library.
+//
+// The node-based tables (the books_by_* indexes and their posting lists, the
+// word index, the due-time and accrual orders, the penalty exposures, the
+// hold queues and the catalog tombstones) allocate from
+// the memory resource given to the constructor, e.g. a
+// std::pmr::unsynchronized_pool_resource for a library filled once by a bulk
+// import. The resource must outlive the library, and must be thread-safe if
+// the library is shared between threads.
 template <typename Duration>
 class Library {
 public:
-    explicit Library(Duration day_duration): clock_(day_duration), id_generator_() {}
+    explicit Library(Duration day_duration, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : clock_(day_duration), id_generator_(), removed_catalog_books_(resource), loans_by_due_time_(resource),
+          penalty_accruals_(resource), penalty_exposure_(resource), holds_(resource), books_by_author_(resource),
+          books_by_genre_(resource), books_by_name_(resource), text_index_(resource) {}
 
-    void add_user(std::shared_ptr<User> user) {
-        if (id_to_user_.find(user->get_id()) != id_to_user_.end()) {
-            throw LibraryOperationException("User with this ID already exists");
-        }
-        id_to_user_.emplace(user->get_id(), user);
+    // The throwing API. Each call wraps its try_ counterpart below and turns a
+    // failure into a LibraryOperationException with the error's message.
+    void add_user(const User& user) {
+        throw_if_error(try_add_user(user));
     }
 
     void add_book(const Book& book) {
-        if (id_to_book_.find(book.get_id()) != id_to_book_.end()) {
-            throw LibraryOperationException("Book with this ID already exists");
-        }
-        id_to_book_.emplace(book.get_id(), book);
-        genres_.insert(book.get_genre());
-        authors_.insert(book.get_author());
-        
-        books_by_author_[book.get_author()].insert(book.get_id());
-        books_by_genre_[book.get_genre()].insert(book.get_id());
-        books_by_name_[book.get_name()].insert(book.get_id());
+        throw_if_error(try_add_book(book));
     }
 
     void remove_user(int user_id) {
-        auto it = id_to_user_.find(user_id);
-        if (it == id_to_user_.end()) {
-            throw LibraryOperationException("User ID not found");
-        }
-        auto user = it->second;
-        if (user->get_borrowed_books().size() > 0) {
-            throw LibraryOperationException("User has borrowed books");
-        }
-        if (user->get_penalty_value() > 0) {
-            throw LibraryOperationException("User has unpaid penalties");
-        }
-        id_to_user_.erase(user_id);
+        throw_if_error(try_remove_user(user_id));
     }
 
     void remove_book(int book_id) {
-        if (id_to_book_.find(book_id) == id_to_book_.end()) {
-            throw LibraryOperationException("Book ID not found");
-        }
-        Book& book = id_to_book_.at(book_id);
-        if (!book.is_available()) {
-            throw LibraryOperationException("Book is borrowed");
-        }
-        
-        books_by_author_[book.get_author()].erase(book_id);
-        books_by_genre_[book.get_genre()].erase(book_id);
-        books_by_name_[book.get_name()].erase(book_id);
-        if (books_by_author_[book.get_author()].empty()) {
-            books_by_author_.erase(book.get_author());
-            authors_.erase(book.get_author());
-        }
-        if (books_by_genre_[book.get_genre()].empty()) {
-            books_by_genre_.erase(book.get_genre());
-            genres_.erase(book.get_genre());
-        }
-        if (books_by_name_[book.get_name()].empty()) {
-            books_by_name_.erase(book.get_name());
-        }
-        
-        id_to_book_.erase(book_id);
+        throw_if_error(try_remove_book(book_id));
     }
 
     void borrow_book(int user_id, int book_id) {
-        auto user_it = id_to_user_.find(user_id);
-        if (user_it == id_to_user_.end()) {
-            throw LibraryOperationException("User ID not found");
+        throw_if_error(try_borrow_book(user_id, book_id));
+    }
+
+    // returns penalty for late return, 0 if no penalty
+    int return_book(int book_id) {
+        ReturnResult result = try_return_book(book_id);
+        throw_if_error(result.error);
+        return result.penalty;
+    }
+
+    void add_penalty(int user_id, int amount) {
+        throw_if_error(try_add_penalty(user_id, amount));
+    }
+
+    void place_hold(int user_id, int book_id) {
+        throw_if_error(try_place_hold(user_id, book_id));
+    }
+
+    void cancel_hold(int user_id, int book_id) {
+        throw_if_error(try_cancel_hold(user_id, book_id));
+    }
+
+    // Non-throwing versions of the calls above. Failures such as an unavailable
+    // book are ordinary outcomes at a busy desk, so they are returned as codes
+    // and cost no more than a successful call.
+    LibraryError try_add_user(const User& user) {
+        return measured(LibraryOperation::ADD_USER, [&] {
+            ExclusiveLock tables(tables_mutex_);
+            return add_user_locked(user);
+        });
+    }
+
+    LibraryError try_add_book(const Book& book) {
+        return measured(LibraryOperation::ADD_BOOK, [&] {
+            ExclusiveLock tables(tables_mutex_);
+            return add_book_locked(book);
+        });
+    }
+
+    // Batch versions of add_user and add_book for bulk loads (see
+    // bulk_import.h): the exclusive lock is taken once per batch. Items are
+    // added in order, and each gets its own result as in borrow_books.
+    std::vector<LibraryError> add_users(const std::vector<User>& users) {
+        ExclusiveLock tables(tables_mutex_);
+        std::vector<LibraryError> results;
+        results.reserve(users.size());
+        for (const User& user : users) {
+            results.push_back(add_user_locked(user));
         }
-        if (id_to_book_.find(book_id) == id_to_book_.end()) {
-            throw LibraryOperationException("Book ID not found");
+        return results;
+    }
+
+    std::vector<LibraryError> add_books(const std::vector<Book>& books) {
+        ExclusiveLock tables(tables_mutex_);
+        books_.reserve(books_.size() + books.size());
+        std::vector<LibraryError> results;
+        results.reserve(books.size());
+        std::vector<std::pair<Symbol, int>> keys; // of the added books
+        keys.reserve(books.size());
+        for (const Book& book : books) {
+            results.push_back(store_book_locked(book));
+            if (results.back() == LibraryError::NONE) {
+                unindexed_text_books_.push_back(book.get_id());
+            }
         }
-        auto user = user_it->second;
-        Book& book = id_to_book_.at(book_id);
-        if (!user->can_borrow()) {
-            throw LibraryOperationException("User has reached borrow limit");
+        text_index_complete_ = false;
+        // The secondary indexes are filled once per batch, key by key: every
+        // key is looked up once, and its ids arrive in ascending order.
+        for (auto [index, key_of] : {std::pair{&books_by_author_, &Book::get_author_symbol},
+                                     std::pair{&books_by_genre_, &Book::get_genre_symbol},
+                                     std::pair{&books_by_name_, &Book::get_name_symbol}}) {
+            keys.clear();
+            for (size_t i = 0; i < books.size(); ++i) {
+                if (results[i] == LibraryError::NONE) {
+                    keys.emplace_back((books[i].*key_of)(), books[i].get_id());
+                }
+            }
+            std::sort(keys.begin(), keys.end());
+            for (size_t i = 0; i < keys.size();) {
+                PostingList& ids = (*index)[keys[i].first];
+                for (Symbol key = keys[i].first; i < keys.size() && keys[i].first == key; ++i) {
+                    ids.insert(keys[i].second);
+                }
+            }
         }
-        if (!book.is_available()) {
-            throw LibraryOperationException("Book is not available");
+        return results;
+    }
+
+    // Grows the book table for `count` more books at once, e.g. from a
+    // first pass over an import file.
+    void reserve_books(size_t count) {
+        ExclusiveLock tables(tables_mutex_);
+        books_.reserve(books_.size() + count);
+    }
+
+    LibraryError try_remove_user(int user_id) {
+        return measured(LibraryOperation::REMOVE_USER, [&] {
+            ExclusiveLock tables(tables_mutex_);
+            const User* user = users_.find(user_id);
+            if (user == nullptr) {
+                return LibraryError::USER_NOT_FOUND;
+            }
+            if (!user->get_loans().empty()) {
+                return LibraryError::USER_HAS_BORROWED_BOOKS;
+            }
+            if (user->get_penalty_value() > 0) {
+                return LibraryError::USER_HAS_PENALTIES;
+            }
+            users_.erase(user_id);
+            if (log_) log_->log_remove_user(user_id);
+            return LibraryError::NONE;
+        });
+    }
+
+    LibraryError try_remove_book(int book_id) {
+        return measured(LibraryOperation::REMOVE_BOOK, [&] {
+            ExclusiveLock tables(tables_mutex_);
+            if (!has_book(book_id)) {
+                return LibraryError::BOOK_NOT_FOUND;
+            }
+            if (!is_book_available(book_id)) {
+                return LibraryError::BOOK_IS_BORROWED;
+            }
+            if (is_catalog_book(book_id)) {
+                // Available catalog books have no overlay copy, so a tombstone is enough.
+                Book book = catalog_->get(book_id);
+                removed_catalog_books_.insert(book_id);
+                ++removed_catalog_keys_[static_cast<int>(CatalogAttribute::AUTHOR)][book.get_author()];
+                ++removed_catalog_keys_[static_cast<int>(CatalogAttribute::GENRE)][book.get_genre()];
+                if (catalog_text_indexed_) {
+                    remove_from_text_index(book);
+                }
+                if (log_) log_->log_remove_book(book_id);
+                return LibraryError::NONE;
+            }
+            Book book = books_.get(book_id);
+
+            erase_from_index(books_by_author_, book.get_author_symbol(), book_id);
+            erase_from_index(books_by_genre_, book.get_genre_symbol(), book_id);
+            erase_from_index(books_by_name_, book.get_name_symbol(), book_id);
+            remove_from_text_index(book);
+            books_.erase(book_id);
+            if (log_) log_->log_remove_book(book_id);
+            return LibraryError::NONE;
+        });
+    }
+
+    // A catalog book is copied into the store while it is on loan, which is a
+    // structural change, so borrowing or returning one takes the exclusive lock.
+    LibraryError try_borrow_book(int user_id, int book_id) {
+        return measured(LibraryOperation::BORROW_BOOK, [&] {
+            auto taken_time = clock_.now();
+            {
+                SharedLock tables(tables_mutex_);
+                if (!is_catalog_book(book_id)) {
+                    std::lock_guard<std::mutex> user_lock(user_locks_.of(user_id));
+                    return try_borrow_at(user_id, book_id, taken_time);
+                }
+            }
+            ExclusiveLock tables(tables_mutex_);
+            return try_borrow_at(user_id, book_id, taken_time);
+        });
+    }
+
+    // The recorded latency ends with the return itself; handing the book to
+    // its next holder and notifying subscribers happen after it.
+    ReturnResult try_return_book(int book_id) {
+        bool set_aside = false;
+        ReturnResult result = measured(LibraryOperation::RETURN_BOOK, [&] {
+            {
+                SharedLock tables(tables_mutex_);
+                if (!is_catalog_book(book_id)) {
+                    // The owner's shard comes first in the lock order, so it is read
+                    // before locking and checked again once both locks are held. A
+                    // missing book or owner is reported by try_return_at.
+                    while (true) {
+                        int user_id = books_.contains(book_id) ? books_.owner(book_id) : BookStore::kNoOwner;
+                        std::lock_guard<std::mutex> user_lock(user_locks_.of(user_id));
+                        std::lock_guard<std::mutex> book_lock(book_locks_.of(book_id));
+                        if (books_.contains(book_id) && books_.owner(book_id) != user_id) {
+                            continue; // returned and borrowed again in between
+                        }
+                        return try_return_at(book_id, set_aside);
+                    }
+                }
+            }
+            ExclusiveLock tables(tables_mutex_);
+            return try_return_at(book_id, set_aside);
+        });
+        if (result.ok()) {
+            after_return(book_id, set_aside);
         }
-        user->borrow_book(book);
-        books_ownership_[book_id] = user_id;
-        borrow_history_.emplace_front(user_id, book_id, BorrowOperationType::BORROW);
+        return result;
     }
 
-    // returns penalty for late return, 0 if no penalty
-    int return_book(int book_id) {
-        if (id_to_book_.find(book_id) == id_to_book_.end()) {
-            throw LibraryOperationException("Book ID not found");
+    LibraryError try_add_penalty(int user_id, int amount) {
+        return measured(LibraryOperation::ADD_PENALTY, [&] {
+            SharedLock tables(tables_mutex_);
+            std::lock_guard<std::mutex> user_lock(user_locks_.of(user_id));
+            User* user = users_.find(user_id);
+            if (user == nullptr) {
+                return LibraryError::USER_NOT_FOUND;
+            }
+            if (amount < 0) {
+                return LibraryError::NEGATIVE_PENALTY;
+            }
+            user->add_penalty(amount);
+            if (log_) log_->log_add_penalty(user_id, amount);
+            return LibraryError::NONE;
+        });
+    }
+
+    // Queues the user for a book that is out. When the book comes back it is
+    // lent straight to the first holder in line, as if they had borrowed it:
+    // holders are served by the hold_priority of their user type, and in the
+    // order they placed their holds within one priority. A hold that waits
+    // longer than the type's hold_days expires. Holds are kept in memory only.
+    LibraryError try_place_hold(int user_id, int book_id) {
+        return measured(LibraryOperation::PLACE_HOLD, [&] {
+            auto now = clock_.now();
+            SharedLock tables(tables_mutex_);
+            std::lock_guard<std::mutex> user_lock(user_locks_.of(user_id));
+            std::lock_guard<std::mutex> book_lock(book_locks_.of(book_id));
+            const User* user = users_.find(user_id);
+            if (user == nullptr) {
+                return LibraryError::USER_NOT_FOUND;
+            }
+            if (!has_book(book_id)) {
+                return LibraryError::BOOK_NOT_FOUND;
+            }
+            // A claimed book is as good as out: its claim always ends in a loan.
+            int owner = books_.contains(book_id) ? books_.owner(book_id) : BookStore::kNoOwner;
+            if (owner == BookStore::kNoOwner) {
+                return LibraryError::BOOK_IS_AVAILABLE;
+            }
+            if (owner == user_id) {
+                return LibraryError::HOLD_ALREADY_PLACED;
+            }
+            const UserPolicy& policy = policy_of(user->get_user_type());
+            std::lock_guard<std::mutex> holds(holds_mutex_);
+            if (!holds_.add(book_id, user_id, static_cast<size_t>(policy.hold_priority),
+                            now + policy.hold_days * clock_.day_length(), now)) {
+                return LibraryError::HOLD_ALREADY_PLACED;
+            }
+            return LibraryError::NONE;
+        });
+    }
+
+    LibraryError try_cancel_hold(int user_id, int book_id) {
+        return measured(LibraryOperation::CANCEL_HOLD, [&] {
+            auto now = clock_.now();
+            std::lock_guard<std::mutex> holds(holds_mutex_);
+            return holds_.remove(book_id, user_id, now) ? LibraryError::NONE : LibraryError::HOLD_NOT_FOUND;
+        });
+    }
+
+    // 1 if the user is next in line for the book, 0 if they hold no live hold
+    // on it. Expired holds count neither here nor in hold_count.
+    size_t hold_position(int user_id, int book_id) const {
+        auto now = clock_.now();
+        std::lock_guard<std::mutex> holds(holds_mutex_);
+        return holds_.position(book_id, user_id, now);
+    }
+
+    size_t hold_count(int book_id) const {
+        auto now = clock_.now();
+        std::lock_guard<std::mutex> holds(holds_mutex_);
+        return holds_.count(book_id, now);
+    }
+
+    // Calls `callback` whenever a returned book becomes available or is lent
+    // to a holder, so clients can wait for books instead of polling. Callbacks
+    // run on the thread that returned the book with no library lock held, so
+    // they may call the library, subscribe and unsubscribe included. A
+    // callback can still run once after its unsubscribe returns, for an event
+    // that was already being published. Returns the id to unsubscribe with.
+    size_t subscribe(std::function<void(const AvailabilityEvent&)> callback) {
+        std::lock_guard<std::mutex> lock(subscribers_mutex_);
+        auto subscribers = std::make_shared<SubscriberList>(subscribers_ ? *subscribers_ : SubscriberList());
+        subscribers->emplace_back(next_subscription_, std::move(callback));
+        subscribers_ = std::move(subscribers);
+        return next_subscription_++;
+    }
+
+    void unsubscribe(size_t subscription) {
+        std::lock_guard<std::mutex> lock(subscribers_mutex_);
+        if (!subscribers_) {
+            return;
         }
-        if (books_ownership_.find(book_id) == books_ownership_.end()) {
-            throw LibraryOperationException("Book was not borrowed");
+        auto subscribers = std::make_shared<SubscriberList>(*subscribers_);
+        subscribers->erase(std::remove_if(subscribers->begin(), subscribers->end(),
+                                          [&](const auto& subscriber) { return subscriber.first == subscription; }),
+                           subscribers->end());
+        subscribers_ = subscribers->empty() ? nullptr : std::move(subscribers);
+    }
+
+    // Batch versions of borrow_book and return_book, for kiosks and return bins.
+    // Items are processed in order, as if the single-item calls were made one
+    // after another, but the locks are taken and the clock is read once per
+    // batch, and the history is appended to once. Failures don't throw: each
+    // item gets its own result, at the same position as in the input.
+    std::vector<LibraryError> borrow_books(const std::vector<std::pair<int, int>>& loans) { // (user_id, book_id)
+        return measured(LibraryOperation::BORROW_BOOKS, [&] {
+            std::vector<LibraryError> results;
+            results.reserve(loans.size());
+            auto taken_time = clock_.now();
+            auto run = [&] {
+                std::vector<LoanRecord> started;
+                started.reserve(loans.size());
+                for (const auto& [user_id, book_id] : loans) {
+                    User* user = nullptr;
+                    LibraryError error = claim_loan(user_id, book_id, user);
+                    if (error == LibraryError::NONE) {
+                        started.push_back(start_loan(*user, book_id, taken_time));
+                    }
+                    results.push_back(error);
+                }
+                std::lock_guard<std::mutex> history(history_mutex_);
+                for (const auto& loan : started) {
+                    record_borrow(loan);
+                }
+            };
+            {
+                SharedLock tables(tables_mutex_);
+                std::uint64_t user_shards = 0, book_shards = 0;
+                bool has_catalog_book = false;
+                for (const auto& [user_id, book_id] : loans) {
+                    user_shards |= LockShards::mask_of(user_id);
+                    book_shards |= LockShards::mask_of(book_id);
+                    has_catalog_book = has_catalog_book || is_catalog_book(book_id);
+                }
+                if (!has_catalog_book) {
+                    ShardSetLock users(user_locks_, user_shards);
+                    ShardSetLock books(book_locks_, book_shards);
+                    run();
+                    return results;
+                }
+            }
+            ExclusiveLock tables(tables_mutex_);
+            run();
+            return results;
+        });
+    }
+
+    // As with return_book, hand-offs to holders are not part of the recorded latency.
+    std::vector<ReturnResult> return_books(const std::vector<int>& book_ids) {
+        std::vector<std::pair<int, bool>> returned; // (book_id, set aside for a holder)
+        std::vector<ReturnResult> outcome = measured(LibraryOperation::RETURN_BOOKS, [&] {
+            std::vector<ReturnResult> results;
+            results.reserve(book_ids.size());
+            auto now = clock_.now();
+            auto run = [&] {
+                std::vector<LoanRecord> ended;
+                ended.reserve(book_ids.size());
+                for (int book_id : book_ids) {
+                    ReturnResult result{LibraryError::NONE, 0};
+                    result.error = check_return(book_id, now, result.penalty);
+                    if (result.error == LibraryError::NONE) {
+                        ended.push_back(end_loan(book_id, result.penalty, now));
+                        returned.emplace_back(book_id, is_set_aside(book_id));
+                    }
+                    results.push_back(result);
+                }
+                std::lock_guard<std::mutex> history(history_mutex_);
+                for (const auto& loan : ended) {
+                    record_return(loan);
+                }
+            };
+            [&] {
+                {
+                    SharedLock tables(tables_mutex_);
+                    bool has_catalog_book = std::any_of(book_ids.begin(), book_ids.end(),
+                                                        [&](int book_id) { return is_catalog_book(book_id); });
+                    if (!has_catalog_book) {
+                        // As in return_book, owners are read before locking their shards and
+                        // checked again afterwards.
+                        while (true) {
+                            std::uint64_t user_shards = 0, book_shards = 0;
+                            for (int book_id : book_ids) {
+                                book_shards |= LockShards::mask_of(book_id);
+                                if (books_.contains(book_id)) {
+                                    user_shards |= LockShards::mask_of(books_.owner(book_id));
+                                }
+                            }
+                            ShardSetLock users(user_locks_, user_shards);
+                            ShardSetLock books(book_locks_, book_shards);
+                            bool owners_locked = std::all_of(book_ids.begin(), book_ids.end(), [&](int book_id) {
+                                return !books_.contains(book_id) || (user_shards & LockShards::mask_of(books_.owner(book_id)));
+                            });
+                            if (owners_locked) {
+                                run();
+                                return;
+                            }
+                        }
+                    }
+                }
+                ExclusiveLock tables(tables_mutex_);
+                run();
+            }();
+            return results;
+        });
+        for (const auto& [book_id, set_aside] : returned) {
+            after_return(book_id, set_aside);
         }
-        Book& book = id_to_book_.at(book_id);
-        int user_id = books_ownership_.at(book_id);
-        auto user_it = id_to_user_.find(user_id);
-        if (user_it == id_to_user_.end()) {
-            throw LibraryOperationException("User not found for borrowed book");
+        return outcome;
+    }
+
+    // Serves the books of a compiled catalog (see catalog_compiler.cpp) straight
+    // from the mapped file. Runtime changes live in the in-memory store on top
+    // of it: added books go there as usual, a catalog book is copied there only
+    // while it is borrowed, and removed catalog books are remembered as
+    // tombstones. Must be called before any book is added.
+    void open_catalog(const std::string& path) {
+        ExclusiveLock tables(tables_mutex_);
+        if (book_count_locked() != 0) {
+            throw LibraryOperationException("Catalog must be opened before books are added");
         }
-        auto user = user_it->second;
-        int days_borrowed = clock_.days_since(book.get_taken_time());
-        books_ownership_.erase(book_id);
-        book.return_book();
-        borrow_history_.emplace_back(user_id, book_id, BorrowOperationType::RETURN);
-        
-        if (days_borrowed <= user->max_borrowed_days()) {
-            return 0;
+        catalog_ = CatalogFile::open(path);
+        catalog_text_indexed_ = false;
+        text_index_complete_ = false;
+        id_generator_.reserve(catalog_->max_book_id());
+    }
+
+    // When a log is attached, every successful mutation is appended to it.
+    // LibraryPersistence attaches its log once recovery is done.
+    void attach_log(WriteAheadLog* log) {
+        ExclusiveLock tables(tables_mutex_);
+        log_ = log;
+    }
+
+    // Read-only visitors over the stored data. Strings and users are handed out by
+    // reference and books are materialized from the store into a few words on the
+    // stack, so nothing is allocated; references are only valid for the duration
+    // of the callback.
+    template <typename F>
+    void for_each_genre(F&& visit) const {
+        SharedLock tables(tables_mutex_);
+        for_each_key(books_by_genre_, CatalogAttribute::GENRE, visit);
+    }
+
+    template <typename F>
+    void for_each_author(F&& visit) const {
+        SharedLock tables(tables_mutex_);
+        for_each_key(books_by_author_, CatalogAttribute::AUTHOR, visit);
+    }
+
+    template <typename F>
+    void for_each_book(F&& visit) const {
+        SharedLock tables(tables_mutex_);
+        std::lock_guard<LockShards> books(book_locks_);
+        books_.for_each(visit);
+        if (catalog_) {
+            catalog_->for_each_book([&](const Book& book) {
+                if (!books_.contains(book.get_id()) && removed_catalog_books_.count(book.get_id()) == 0) {
+                    visit(book);
+                }
+            });
         }
-        int penalty = (days_borrowed - user->max_borrowed_days()) * user->get_penalty_for_one_day();
-        user->add_penalty(penalty);
-        return penalty;
+    }
+
+    template <typename F>
+    void for_each_user(F&& visit) const {
+        SharedLock tables(tables_mutex_);
+        std::lock_guard<LockShards> users(user_locks_);
+        users_.for_each(visit);
+    }
+
+    // visit(user_id, book_id, operation_type), oldest first
+    template <typename F>
+    void for_each_borrow_record(F&& visit) const {
+        std::lock_guard<std::mutex> history(history_mutex_);
+        borrow_history_.for_each([&](const BorrowEvent& event) {
+            visit(event.user_id, event.book_id, event.op_type);
+        });
+    }
+
+    // visit(const BorrowEvent&) for the events matching the query, oldest first
+    template <typename F>
+    void for_each_borrow_event(const HistoryQuery& query, F&& visit) const {
+        std::lock_guard<std::mutex> history(history_mutex_);
+        borrow_history_.for_each(query, visit);
+    }
+
+    size_t book_count() const {
+        SharedLock tables(tables_mutex_);
+        return book_count_locked();
+    }
+
+    size_t user_count() const {
+        SharedLock tables(tables_mutex_);
+        return users_.size();
+    }
+
+    size_t borrow_history_size() const {
+        std::lock_guard<std::mutex> history(history_mutex_);
+        return borrow_history_.size();
+    }
+
+    // Keeps at least the newest `events` history events; older ones are
+    // dropped a chunk at a time (see BorrowHistory).
+    void set_history_retention(size_t events) {
+        std::lock_guard<std::mutex> history(history_mutex_);
+        borrow_history_.set_retention(events);
+    }
+
+    // Where loans, returns and overdue checks read the time (see
+    // time_source.h); nullptr, the default, reads system_clock. The source
+    // must outlive the library or be replaced first. Loans already stamped
+    // keep their times, so switch sources before the first loan unless the
+    // new one continues the old one's time.
+    void set_time_source(const TimeSource* source) {
+        clock_.set_source(source);
     }
 
     std::unordered_set<std::string> get_all_genres() const {
-        return genres_;
+        std::unordered_set<std::string> result;
+        for_each_genre([&](std::string_view genre) { result.emplace(genre); });
+        return result;
     }
 
     std::unordered_set<std::string> get_all_authors() const {
-        return authors_;
+        std::unordered_set<std::string> result;
+        for_each_author([&](std::string_view author) { result.emplace(author); });
+        return result;
     }
 
     std::unordered_map<int, Book> get_all_books() const {
-        return id_to_book_;
+        std::unordered_map<int, Book> result;
+        result.reserve(book_count());
+        for_each_book([&](const Book& book) { result.emplace(book.get_id(), book); });
+        return result;
     }
 
-    std::unordered_map<int, std::shared_ptr<User>> get_all_users() const {
-        return id_to_user_;
+    std::unordered_map<int, User> get_all_users() const {
+        std::unordered_map<int, User> result;
+        result.reserve(user_count());
+        for_each_user([&](const User& user) { result.emplace(user.get_id(), user); });
+        return result;
     }
 
     std::optional<Book> get_book_by_id(int book_id) {
-        if (id_to_book_.find(book_id) == id_to_book_.end()) {
+        SharedLock tables(tables_mutex_);
+        std::lock_guard<std::mutex> book_lock(book_locks_.of(book_id));
+        if (!has_book(book_id)) {
             return std::nullopt;
         }
-        return id_to_book_.at(book_id);
+        return book_at(book_id);
     }
 
-    std::shared_ptr<User> get_user_by_id(int user_id) {
-        auto it = id_to_user_.find(user_id);
-        if (it == id_to_user_.end()) {
-            return nullptr;
+    // A copy of the user as of the call.
+    std::optional<User> get_user_by_id(int user_id) const {
+        SharedLock tables(tables_mutex_);
+        std::lock_guard<std::mutex> user_lock(user_locks_.of(user_id));
+        const User* user = users_.find(user_id);
+        if (user == nullptr) {
+            return std::nullopt;
         }
-        return it->second;
+        return *user;
     }
 
-    std::vector<Book> get_books_by_name(const std::string& name) {
-        if (books_by_name_.find(name) == books_by_name_.end()) {
-            return {};
+    // Books whose name or author contains every word of the query, e.g. "tolkien
+    // rings" (whole words, ASCII case-insensitive), in id order and at most
+    // `limit` of them.
+    std::vector<Book> search_books(const std::string& query, size_t limit = std::numeric_limits<size_t>::max()) {
+        return measured(LibraryOperation::SEARCH_BOOKS, [&] {
+            SharedLock tables = lock_complete_text_index();
+            std::vector<Book> result;
+            for (int book_id : text_index_.search(query, limit)) {
+                std::lock_guard<std::mutex> book_lock(book_locks_.of(book_id));
+                result.push_back(book_at(book_id));
+            }
+            return result;
+        });
+    }
+
+    // Words of book names and authors starting with prefix, for autocomplete.
+    std::vector<std::string> complete_search_word(const std::string& prefix, size_t limit) {
+        SharedLock tables = lock_complete_text_index();
+        return text_index_.complete(prefix, limit);
+    }
+
+    // Plans a query over several filters (see QueryPlan) and returns a cursor
+    // over the ids of the matching books, e.g. query_books(query).next_page(20).
+    // The driver is the attribute filter with the fewest books.
+    BookCursor<Library> query_books(const BookQuery& query) const {
+        SharedLock tables(tables_mutex_);
+        QueryPlan plan;
+        plan.query = query;
+        size_t fewest = std::numeric_limits<size_t>::max();
+        for (auto attribute : {CatalogAttribute::AUTHOR, CatalogAttribute::GENRE, CatalogAttribute::NAME}) {
+            const auto& value = query.value_of(attribute);
+            if (value) {
+                size_t count = count_books_with(attribute, *value);
+                if (count < fewest) {
+                    fewest = count;
+                    plan.driver = attribute;
+                }
+            }
         }
-        std::vector<Book> result;
-        for (int book_id : books_by_name_.at(name)) {
-            result.push_back(id_to_book_.at(book_id));
+        if (plan.driver) {
+            plan.candidates = ids_of_books_with(*plan.driver, *query.value_of(*plan.driver));
+            for (auto attribute : {CatalogAttribute::AUTHOR, CatalogAttribute::GENRE, CatalogAttribute::NAME}) {
+                const auto& value = query.value_of(attribute);
+                if (value && attribute != *plan.driver) {
+                    keep_books_with(attribute, *value, plan.candidates);
+                }
+            }
+        } else {
+            plan.candidates = all_book_ids(query.available_only);
         }
+        return BookCursor<Library>(*this, std::move(plan));
+    }
+
+    std::vector<Book> get_books_by_name(const std::string& name) {
+        std::vector<Book> result;
+        get_books_by_key(books_by_name_, CatalogAttribute::NAME, name, result);
         return result;
     }
 
     std::vector<Book> get_books_by_author(const std::string& author) {
-        if (books_by_author_.find(author) == books_by_author_.end()) {
-            return {};
-        }
         std::vector<Book> result;
-        for (int book_id : books_by_author_.at(author)) {
-            result.push_back(id_to_book_.at(book_id));
-        }
+        get_books_by_key(books_by_author_, CatalogAttribute::AUTHOR, author, result);
         return result;
     }
 
     std::vector<Book> get_books_by_genre(const std::string& genre) {
-        if (books_by_genre_.find(genre) == books_by_genre_.end()) {
-            return {};
-        }
         std::vector<Book> result;
-        for (int book_id : books_by_genre_.at(genre)) {
-            result.push_back(id_to_book_.at(book_id));
-        }
+        get_books_by_key(books_by_genre_, CatalogAttribute::GENRE, genre, result);
+        return result;
+    }
+
+    // The same lookups with the result allocated from the caller's scratch
+    // resource, e.g. a std::pmr::monotonic_buffer_resource over a buffer that
+    // is released after each query.
+    std::pmr::vector<Book> get_books_by_name(const std::string& name, std::pmr::memory_resource* scratch) const {
+        std::pmr::vector<Book> result(scratch);
+        get_books_by_key(books_by_name_, CatalogAttribute::NAME, name, result);
+        return result;
+    }
+
+    std::pmr::vector<Book> get_books_by_author(const std::string& author, std::pmr::memory_resource* scratch) const {
+        std::pmr::vector<Book> result(scratch);
+        get_books_by_key(books_by_author_, CatalogAttribute::AUTHOR, author, result);
+        return result;
+    }
+
+    std::pmr::vector<Book> get_books_by_genre(const std::string& genre, std::pmr::memory_resource* scratch) const {
+        std::pmr::vector<Book> result(scratch);
+        get_books_by_key(books_by_genre_, CatalogAttribute::GENRE, genre, result);
         return result;
     }
 
     std::deque<std::tuple<int, int, BorrowOperationType>> get_borrow_history() const {
-        return borrow_history_;
+        std::deque<std::tuple<int, int, BorrowOperationType>> result;
+        for_each_borrow_record([&](int user_id, int book_id, BorrowOperationType op_type) {
+            result.emplace_back(user_id, book_id, op_type);
+        });
+        return result;
+    }
+
+    // e.g. get_borrow_history({user_id, std::nullopt, from, to}) for one user's
+    // activity over a period.
+    std::vector<BorrowEvent> get_borrow_history(const HistoryQuery& query) const {
+        std::vector<BorrowEvent> result;
+        for_each_borrow_event(query, [&](const BorrowEvent& event) {
+            result.push_back(event);
+        });
+        return result;
     }
 
 
     std::set<Book> get_borrowed_books() const {
-        std::set<Book> result;
-        for (auto [book_id, user_id]: books_ownership_) {
-            const Book& book = id_to_book_.at(book_id);
-            result.insert(book);
-        }
-        return result;
+        return measured(LibraryOperation::GET_BORROWED_BOOKS, [&] {
+            SharedLock tables(tables_mutex_);
+            std::lock_guard<LockShards> books(book_locks_);
+            std::set<Book> result;
+            books_.for_each_borrowed([&](int book_id, int, std::chrono::system_clock::time_point) {
+                result.insert(books_.get(book_id));
+            });
+            return result;
+        });
+    }
+
+    // A loan is overdue once a full day has passed after its due time, the same
+    // point at which return_book starts charging a penalty. Loans are kept ordered
+    // by due time, so only the overdue prefix is visited, with a single clock read.
+    std::vector<int> get_overdue_book_ids() const {
+        return measured(LibraryOperation::GET_OVERDUE_BOOK_IDS, [&] {
+            std::lock_guard<std::mutex> history(history_mutex_);
+            return overdue_book_ids_locked();
+        });
     }
 
     std::set<Book> get_overdue_books() const {
-        std::set<Book> result;
-        for (const auto& [book_id, user_id] : books_ownership_) {
-            const Book& book = id_to_book_.at(book_id);
-            const auto& user = id_to_user_.at(user_id);
-            int days_borrowed = clock_.days_since(book.get_taken_time());
-            if (days_borrowed > user->max_borrowed_days()) {
-                result.insert(book);
+        return measured(LibraryOperation::GET_OVERDUE_BOOKS, [&] {
+            SharedLock tables(tables_mutex_);
+            std::lock_guard<LockShards> books(book_locks_);
+            std::lock_guard<std::mutex> history(history_mutex_);
+            std::set<Book> result;
+            for (int book_id : overdue_book_ids_locked()) {
+                result.insert(books_.get(book_id));
             }
-        }
-        return result;
+            return result;
+        });
     }
     
+    // The day tick of the fines: charges the owner of every loan the fines of
+    // the overdue days that have started since it was last charged, with
+    // User::add_penalty, so penalties show while books are still out. Loans
+    // are kept ordered by the next day they owe, so a tick visits only the
+    // loans it charges, and one with nothing due costs a clock read and a
+    // lock. return_book charges whatever the ticks have not. Returns the number
+    // of loans charged.
+    //
+    // Accrued fines are not logged: a library restored from disk charges them
+    // again, from the due times, on its first tick.
+    size_t accrue_penalties() {
+        return measured(LibraryOperation::ACCRUE_PENALTIES, [&] {
+            auto now = clock_.now();
+            {
+                std::lock_guard<std::mutex> history(history_mutex_);
+                if (penalty_accruals_.empty() || penalty_accruals_.begin()->first > now) {
+                    return size_t{0};
+                }
+            }
+            SharedLock tables(tables_mutex_);
+            std::lock_guard<LockShards> users(user_locks_);
+            std::lock_guard<LockShards> books(book_locks_);
+            std::lock_guard<std::mutex> history(history_mutex_);
+            size_t charged = 0;
+            auto day = clock_.day_length();
+            while (!penalty_accruals_.empty() && penalty_accruals_.begin()->first <= now) {
+                auto next = penalty_accruals_.extract(penalty_accruals_.begin());
+                int book_id = next.value().second;
+                int days = static_cast<int>((now - next.value().first) / day) + 1;
+                User& user = *users_.find(books_.owner(book_id));
+                int amount = days * user.get_penalty_for_one_day();
+                books_.add_accrued_days(book_id, days);
+                user.add_penalty(amount);
+                penalty_exposure_[user.get_id()] += amount;
+                outstanding_penalties_ += amount;
+                next.value().first += days * day;
+                penalty_accruals_.insert(std::move(next));
+                ++charged;
+            }
+            return charged;
+        });
+    }
+
+    // Fines accrued on books that are still out, in total and for one user.
+    long long outstanding_penalties() const {
+        std::lock_guard<std::mutex> history(history_mutex_);
+        return outstanding_penalties_;
+    }
+
+    long long penalty_exposure(int user_id) const {
+        std::lock_guard<std::mutex> history(history_mutex_);
+        auto it = penalty_exposure_.find(user_id);
+        return it == penalty_exposure_.end() ? 0 : it->second;
+    }
+
+    // visit(user_id, fines accrued on the user's books still out), for every
+    // user with a non-zero exposure, in no particular order.
+    template <typename F>
+    void for_each_penalty_exposure(F&& visit) const {
+        std::lock_guard<std::mutex> history(history_mutex_);
+        for (const auto& [user_id, amount] : penalty_exposure_) {
+            visit(user_id, amount);
+        }
+    }
+
+    // Calls, failures by reason and latency percentiles of the operations
+    // recorded so far (see library_metrics.h); empty when built with
+    // LIBRARY_METRICS=0. Safe to call while the library is in use.
+    MetricsSnapshot metrics() const {
+#if LIBRARY_METRICS
+        return metrics_.snapshot([](std::uint8_t code) { return error_message(static_cast<LibraryError>(code)); });
+#else
+        return MetricsSnapshot();
+#endif
+    }
+
     int get_next_book_id() {
         return id_generator_.get_next_id();
     }
@@ -251,16 +1027,648 @@ public:
     }
 
 private:
+    friend class LibraryPersistence<Duration>;
+    friend class BookCursor<Library>;
+
+    using SharedLock = std::shared_lock<std::shared_mutex>;
+    using ExclusiveLock = std::unique_lock<std::shared_mutex>;
+
+    LibraryError add_user_locked(const User& user) {
+        if (user.get_id() < 0) {
+            return LibraryError::NEGATIVE_USER_ID;
+        }
+        if (users_.contains(user.get_id())) {
+            return LibraryError::USER_ALREADY_EXISTS;
+        }
+        users_.insert(user);
+        id_generator_.reserve(user.get_id());
+        if (log_) log_->log_add_user(user);
+        return LibraryError::NONE;
+    }
+
+    LibraryError add_book_locked(const Book& book) {
+        LibraryError error = store_book_locked(book);
+        if (error == LibraryError::NONE) {
+            add_to_text_index(book);
+            books_by_author_[book.get_author_symbol()].insert(book.get_id());
+            books_by_genre_[book.get_genre_symbol()].insert(book.get_id());
+            books_by_name_[book.get_name_symbol()].insert(book.get_id());
+        }
+        return error;
+    }
+
+    // Everything add_book does except updating the attribute and word indexes.
+    LibraryError store_book_locked(const Book& book) {
+        if (book.get_id() < 0) {
+            return LibraryError::NEGATIVE_BOOK_ID;
+        }
+        if (has_book(book.get_id())) {
+            return LibraryError::BOOK_ALREADY_EXISTS;
+        }
+        books_.insert(book);
+        id_generator_.reserve(book.get_id());
+        if (log_) log_->log_add_book(book.get_id(), book.get_name(), book.get_author(), book.get_genre());
+        return LibraryError::NONE;
+    }
+
+    // Runs body() as one call of the operation: with metrics enabled, its time
+    // and the results it returns are recorded.
+    template <typename F>
+    auto measured([[maybe_unused]] LibraryOperation operation, F&& body) const {
+#if LIBRARY_METRICS
+        auto started = std::chrono::steady_clock::now();
+        auto result = body();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started);
+        metrics_.record(operation, static_cast<std::uint64_t>(elapsed.count()), [&](auto&& count) { count_results(result, count); });
+        return result;
+#else
+        return body();
+#endif
+    }
+
+    template <typename F>
+    static void count_results(LibraryError error, F& count) { count(static_cast<std::uint8_t>(error)); }
+
+    template <typename F>
+    static void count_results(const ReturnResult& result, F& count) { count(static_cast<std::uint8_t>(result.error)); }
+
+    template <typename F>
+    static void count_results(const std::vector<LibraryError>& results, F& count) {
+        for (LibraryError error : results) {
+            count_results(error, count);
+        }
+    }
+
+    template <typename F>
+    static void count_results(const std::vector<ReturnResult>& results, F& count) {
+        for (const auto& result : results) {
+            count_results(result, count);
+        }
+    }
+
+    // Queries cannot fail; a call counts as one successful item.
+    template <typename T, typename F>
+    static void count_results(const T&, F& count) { count(std::uint8_t{0}); }
+
+    static void throw_if_error(LibraryError error) {
+        if (error != LibraryError::NONE) {
+            throw LibraryOperationException(error_message(error));
+        }
+    }
+
+    // The methods below expect the caller to hold the locks of the rows they
+    // touch (or tables_mutex_ exclusively), see the class comment. The
+    // exception is try_borrow_at, which is entered with only the user's shard
+    // and locks the book's shard itself once its claim has succeeded.
+
+    struct LoanRecord {
+        int user_id;
+        int book_id;
+        std::chrono::system_clock::time_point due_time;
+        std::chrono::system_clock::time_point time; // when the loan started or ended
+        int accrued_days = 0; // overdue days charged before the return, and their fines
+        int accrued_penalty = 0;
+    };
+
+    // The taken time is a parameter so that recovery can replay a loan exactly.
+    void borrow_book_at(int user_id, int book_id, std::chrono::system_clock::time_point taken_time) {
+        throw_if_error(try_borrow_at(user_id, book_id, taken_time));
+    }
+
+    LibraryError try_borrow_at(int user_id, int book_id, std::chrono::system_clock::time_point taken_time) {
+        User* user = nullptr;
+        LibraryError error = claim_loan(user_id, book_id, user);
+        if (error != LibraryError::NONE) {
+            return error;
+        }
+        LoanRecord loan;
+        {
+            std::lock_guard<std::mutex> book_lock(book_locks_.of(book_id));
+            loan = start_loan(*user, book_id, taken_time);
+        }
+        std::lock_guard<std::mutex> history(history_mutex_);
+        record_borrow(loan);
+        return LibraryError::NONE;
+    }
+
+    // Validates a loan and claims the book for the user, who is handed back
+    // through `user`. Needs only the user's shard; start_loan must follow.
+    LibraryError claim_loan(int user_id, int book_id, User*& user) {
+        user = users_.find(user_id);
+        if (user == nullptr) {
+            return LibraryError::USER_NOT_FOUND;
+        }
+        if (!has_book(book_id)) {
+            return LibraryError::BOOK_NOT_FOUND;
+        }
+        if (!user->can_borrow()) {
+            return LibraryError::BORROW_LIMIT_REACHED;
+        }
+        if (!is_book_available(book_id)) {
+            return LibraryError::BOOK_NOT_AVAILABLE;
+        }
+        if (!books_.contains(book_id)) {
+            books_.insert(catalog_->get(book_id));
+            ++borrowed_catalog_books_;
+        }
+        if (!books_.try_claim(book_id, user_id)) {
+            return LibraryError::BOOK_NOT_AVAILABLE;
+        }
+        return LibraryError::NONE;
+    }
+
+    // Publishes a claimed loan; the book's shard must be held as well.
+    LoanRecord start_loan(User& user, int book_id, std::chrono::system_clock::time_point taken_time) {
+        user.borrow_book(book_id);
+        auto due_time = taken_time + user.max_borrowed_days() * clock_.day_length();
+        books_.take(book_id, taken_time, due_time);
+        if (log_) log_->log_borrow(user.get_id(), book_id, taken_time);
+        return {user.get_id(), book_id, due_time, taken_time};
+    }
+
+    // set_aside tells whether the book now waits for hand_off to a holder.
+    ReturnResult try_return_at(int book_id, bool& set_aside) {
+        ReturnResult result{LibraryError::NONE, 0};
+        auto now = clock_.now();
+        result.error = check_return(book_id, now, result.penalty);
+        if (result.error == LibraryError::NONE) {
+            finish_return(book_id, result.penalty, now);
+            set_aside = is_set_aside(book_id);
+        }
+        return result;
+    }
+
+    // Checks the book can be returned at `now` and computes the late penalty.
+    // A claimed loan only counts once start_loan has published it.
+    LibraryError check_return(int book_id, std::chrono::system_clock::time_point now, int& penalty) const {
+        if (!has_book(book_id)) {
+            return LibraryError::BOOK_NOT_FOUND;
+        }
+        if (!books_.contains(book_id) || books_.is_available(book_id) || is_set_aside(book_id)) {
+            return LibraryError::BOOK_NOT_BORROWED;
+        }
+        const User* user = users_.find(books_.owner(book_id));
+        if (user == nullptr) {
+            return LibraryError::OWNER_NOT_FOUND;
+        }
+        // Never less than accrue_penalties() has charged already, even if the
+        // clock was set back since.
+        int days_overdue = std::max(clock_.days_between(books_.taken_time(book_id), now) - user->max_borrowed_days(),
+                                    books_.accrued_days(book_id));
+        penalty = days_overdue > 0 ? days_overdue * user->get_penalty_for_one_day() : 0;
+        return LibraryError::NONE;
+    }
+
+    // Precondition: the book is borrowed by an existing user.
+    void finish_return(int book_id, int penalty, std::chrono::system_clock::time_point returned_time) {
+        LoanRecord loan = end_loan(book_id, penalty, returned_time);
+        std::lock_guard<std::mutex> history(history_mutex_);
+        record_return(loan);
+    }
+
+    // Charges the owner what `penalty` adds to the fines accrued on the loan.
+    // A book with holds is set aside for hand_off instead of given back.
+    LoanRecord end_loan(int book_id, int penalty, std::chrono::system_clock::time_point returned_time) {
+        LoanRecord loan{books_.owner(book_id), book_id, books_.due_time(book_id), returned_time, books_.accrued_days(book_id)};
+        bool has_holds;
+        {
+            std::lock_guard<std::mutex> holds(holds_mutex_);
+            has_holds = holds_.has_holds(book_id);
+        }
+        if (has_holds) {
+            books_.set_aside(book_id);
+        } else {
+            books_.give_back(book_id);
+            if (is_catalog_book(book_id)) {
+                books_.erase(book_id);
+                --borrowed_catalog_books_;
+            }
+        }
+        User& user = *users_.find(loan.user_id);
+        user.return_book(book_id);
+        loan.accrued_penalty = loan.accrued_days * user.get_penalty_for_one_day();
+        if (penalty > loan.accrued_penalty) {
+            user.add_penalty(penalty - loan.accrued_penalty);
+        }
+        if (log_) log_->log_return(book_id, penalty, returned_time);
+        return loan;
+    }
+
+    // Expect history_mutex_ to be held.
+    void record_borrow(const LoanRecord& loan) {
+        loans_by_due_time_.emplace(loan.due_time, loan.book_id);
+        penalty_accruals_.emplace(loan.due_time + clock_.day_length(), loan.book_id);
+        borrow_history_.append({loan.user_id, loan.book_id, BorrowOperationType::BORROW, loan.time});
+    }
+
+    void record_return(const LoanRecord& loan) {
+        loans_by_due_time_.erase({loan.due_time, loan.book_id});
+        penalty_accruals_.erase({loan.due_time + (loan.accrued_days + 1) * clock_.day_length(), loan.book_id});
+        if (loan.accrued_penalty > 0) {
+            auto exposure = penalty_exposure_.find(loan.user_id);
+            if ((exposure->second -= loan.accrued_penalty) == 0) {
+                penalty_exposure_.erase(exposure);
+            }
+            outstanding_penalties_ -= loan.accrued_penalty;
+        }
+        borrow_history_.append({loan.user_id, loan.book_id, BorrowOperationType::RETURN, loan.time});
+    }
+
+    // Expects the book's shard: whether a return left the book for hand_off.
+    bool is_set_aside(int book_id) const {
+        return books_.contains(book_id) && books_.owner(book_id) == BookStore::kSetAside;
+    }
+
+    // Runs once a return's locks are released.
+    void after_return(int book_id, bool set_aside) {
+        if (set_aside) {
+            hand_off(book_id);
+        } else {
+            publish({book_id, BookStore::kNoOwner});
+        }
+    }
+
+    // Lends a book that was set aside to the first holder in line who can
+    // still borrow it, as borrow_book would, or makes it available if there
+    // is none. Holders that were removed or are at their borrow limit lose
+    // their hold. The holder's shard comes before the book's in the lock
+    // order, so the holder is read first and checked again under the locks.
+    void hand_off(int book_id) {
+        while (true) {
+            int holder;
+            {
+                std::lock_guard<std::mutex> holds(holds_mutex_);
+                holder = holds_.front(book_id, clock_.now());
+            }
+            std::optional<AvailabilityEvent> event;
+            bool catalog_book;
+            {
+                SharedLock tables(tables_mutex_);
+                catalog_book = is_catalog_book(book_id);
+                if (!catalog_book) {
+                    std::lock_guard<std::mutex> user_lock(user_locks_.of(holder));
+                    std::lock_guard<std::mutex> book_lock(book_locks_.of(book_id));
+                    event = hand_off_to(book_id, holder);
+                }
+            }
+            if (catalog_book) {
+                ExclusiveLock tables(tables_mutex_);
+                event = hand_off_to(book_id, holder);
+            }
+            if (event) {
+                publish(*event);
+                return;
+            }
+        }
+    }
+
+    // One step of hand_off, with the holder's and the book's shards held (or
+    // tables_mutex_ exclusively). Returns nothing if the line has changed
+    // since `holder` was read or the holder could not take the book.
+    std::optional<AvailabilityEvent> hand_off_to(int book_id, int holder) {
+        auto now = clock_.now();
+        std::unique_lock<std::mutex> holds(holds_mutex_);
+        if (holds_.front(book_id, now) != holder) {
+            return std::nullopt;
+        }
+        if (holder == HoldQueues::kNoHolder) {
+            books_.release(book_id);
+            if (is_catalog_book(book_id)) {
+                books_.erase(book_id);
+                --borrowed_catalog_books_;
+            }
+            return AvailabilityEvent{book_id, BookStore::kNoOwner};
+        }
+        holds_.pop_front(book_id);
+        holds.unlock();
+        User* user = users_.find(holder);
+        if (user == nullptr || !user->can_borrow()) {
+            return std::nullopt;
+        }
+        books_.hand_over(book_id, holder);
+        LoanRecord loan = start_loan(*user, book_id, now);
+        std::lock_guard<std::mutex> history(history_mutex_);
+        record_borrow(loan);
+        return AvailabilityEvent{book_id, holder};
+    }
+
+    // Calls the subscribers of the moment after letting go of the list, so a
+    // callback that returns a book, and publishes again, takes no lock twice.
+    void publish(const AvailabilityEvent& event) const {
+        std::shared_ptr<const SubscriberList> subscribers;
+        {
+            std::lock_guard<std::mutex> lock(subscribers_mutex_);
+            subscribers = subscribers_;
+        }
+        if (subscribers) {
+            for (const auto& subscriber : *subscribers) {
+                subscriber.second(event);
+            }
+        }
+    }
+
+    size_t book_count_locked() const {
+        size_t catalog_books = catalog_ ? catalog_->book_count() - removed_catalog_books_.size() : 0;
+        return books_.size() - borrowed_catalog_books_ + catalog_books;
+    }
+
+    // Expects history_mutex_ to be held.
+    std::vector<int> overdue_book_ids_locked() const {
+        auto cutoff = clock_.now() - clock_.day_length();
+        std::vector<int> result;
+        for (auto it = loans_by_due_time_.begin(); it != loans_by_due_time_.end() && it->first <= cutoff; ++it) {
+            result.push_back(it->second);
+        }
+        return result;
+    }
+
+    using BookIndex = std::pmr::unordered_map<Symbol, PostingList>;
+
+    bool is_catalog_book(int book_id) const {
+        return catalog_ && removed_catalog_books_.count(book_id) == 0 && catalog_->contains(book_id);
+    }
+
+    bool has_book(int book_id) const {
+        return books_.contains(book_id) || is_catalog_book(book_id);
+    }
+
+    // Precondition: has_book(book_id).
+    bool is_book_available(int book_id) const {
+        return !books_.contains(book_id) || books_.is_available(book_id);
+    }
+
+    // Precondition: has_book(book_id).
+    Book book_at(int book_id) const {
+        return books_.contains(book_id) ? books_.get(book_id) : catalog_->get(book_id);
+    }
+
+    // A catalog key is listed while at least one of its books is still there.
+    bool is_catalog_key_live(CatalogAttribute attribute, std::string_view key, size_t book_count) const {
+        const auto& removed = removed_catalog_keys_[static_cast<int>(attribute)];
+        auto it = removed.find(key);
+        return it == removed.end() || it->second < book_count;
+    }
+
+    template <typename F>
+    void for_each_key(const BookIndex& index, CatalogAttribute attribute, F& visit) const {
+        for (const auto& [key, book_ids] : index) {
+            std::string_view text = string_pool().str(key);
+            if (catalog_) {
+                CatalogIds catalog_ids = catalog_->postings(attribute, text);
+                if (!catalog_ids.empty() && is_catalog_key_live(attribute, text, catalog_ids.size())) {
+                    continue; // listed with the catalog keys below
+                }
+            }
+            visit(text);
+        }
+        if (catalog_) {
+            catalog_->for_each_key(attribute, [&](std::string_view text, CatalogIds catalog_ids) {
+                if (is_catalog_key_live(attribute, text, catalog_ids.size())) {
+                    visit(text);
+                }
+            });
+        }
+    }
+
+    // The key is resolved through the string pool once; a string that was
+    // never interned cannot be the key of any added book. Only the shard of the
+    // book being copied out is locked, so lookups don't stall borrowing.
+    template <typename Books>
+    void get_books_by_key(const BookIndex& index, CatalogAttribute attribute, const std::string& key, Books& result) const {
+        SharedLock tables(tables_mutex_);
+        if (auto symbol = string_pool().find(key)) {
+            auto it = index.find(*symbol);
+            if (it != index.end()) {
+                result.reserve(it->second.size());
+                for (int book_id : it->second) {
+                    std::lock_guard<std::mutex> book_lock(book_locks_.of(book_id));
+                    result.push_back(books_.get(book_id));
+                }
+            }
+        }
+        if (catalog_) {
+            for (int book_id : catalog_->postings(attribute, key)) {
+                if (removed_catalog_books_.count(book_id) == 0) {
+                    std::lock_guard<std::mutex> book_lock(book_locks_.of(book_id));
+                    result.push_back(book_at(book_id));
+                }
+            }
+        }
+    }
+
+    void add_to_text_index(const Book& book) {
+        text_index_.add(book.get_id(), book.get_name());
+        text_index_.add(book.get_id(), book.get_author());
+    }
+
+    void remove_from_text_index(const Book& book) {
+        text_index_.remove(book.get_id(), book.get_name());
+        text_index_.remove(book.get_id(), book.get_author());
+    }
+
+    // Catalog books are indexed on the first search rather than in
+    // open_catalog, which only maps and checks the file, and books from
+    // add_books() on the next search, so a bulk load does not pay for the
+    // word index.
+    //
+    // Returns a shared lock on the tables, taken once text_index_ covers
+    // every book.
+    SharedLock lock_complete_text_index() {
+        SharedLock tables(tables_mutex_);
+        if (!text_index_complete_) {
+            tables.unlock();
+            complete_text_index();
+            tables.lock();
+        }
+        return tables;
+    }
+
+    void complete_text_index() {
+        ExclusiveLock tables(tables_mutex_);
+        if (text_index_complete_) {
+            return;
+        }
+        if (catalog_ && !catalog_text_indexed_) {
+            catalog_->for_each_book([&](const Book& book) {
+                if (removed_catalog_books_.count(book.get_id()) == 0) {
+                    add_to_text_index(book);
+                }
+            });
+        }
+        catalog_text_indexed_ = true;
+        for (int book_id : unindexed_text_books_) {
+            // Removed books are skipped; re-added ones are indexed already,
+            // and indexing them again is harmless.
+            if (has_book(book_id)) {
+                add_to_text_index(book_at(book_id));
+            }
+        }
+        unindexed_text_books_ = {};
+        text_index_complete_ = true;
+    }
+
+    const BookIndex& index_of(CatalogAttribute attribute) const {
+        switch (attribute) {
+        case CatalogAttribute::AUTHOR: return books_by_author_;
+        case CatalogAttribute::GENRE: return books_by_genre_;
+        default: return books_by_name_;
+        }
+    }
+
+    // Upper bound: removed catalog books are still counted.
+    size_t count_books_with(CatalogAttribute attribute, const std::string& value) const {
+        size_t count = catalog_ ? catalog_->postings(attribute, value).size() : 0;
+        if (auto symbol = string_pool().find(value)) {
+            const BookIndex& index = index_of(attribute);
+            auto it = index.find(*symbol);
+            if (it != index.end()) {
+                count += it->second.size();
+            }
+        }
+        return count;
+    }
+
+    std::vector<int> ids_of_books_with(CatalogAttribute attribute, const std::string& value) const {
+        std::vector<int> ids;
+        if (auto symbol = string_pool().find(value)) {
+            const BookIndex& index = index_of(attribute);
+            auto it = index.find(*symbol);
+            if (it != index.end()) {
+                ids.assign(it->second.begin(), it->second.end());
+            }
+        }
+        if (catalog_) {
+            size_t added_books = ids.size();
+            for (int book_id : catalog_->postings(attribute, value)) {
+                if (removed_catalog_books_.count(book_id) == 0) {
+                    ids.push_back(book_id);
+                }
+            }
+            // Both parts are sorted already.
+            std::inplace_merge(ids.begin(), ids.begin() + added_books, ids.end());
+        }
+        return ids;
+    }
+
+    // Drops the ascending ids of books without the value. Catalog postings
+    // are galloped through, as TextIndex intersects its lists, and the added
+    // books' posting list is probed per id.
+    void keep_books_with(CatalogAttribute attribute, const std::string& value, std::vector<int>& ids) const {
+        const PostingList* added = nullptr;
+        if (auto symbol = string_pool().find(value)) {
+            const BookIndex& index = index_of(attribute);
+            auto it = index.find(*symbol);
+            if (it != index.end()) {
+                added = &it->second;
+            }
+        }
+        CatalogIds catalog_ids = catalog_ ? catalog_->postings(attribute, value) : CatalogIds{};
+        size_t cursor = 0;
+        auto kept = std::remove_if(ids.begin(), ids.end(), [&](int book_id) {
+            if (added != nullptr && added->contains(book_id)) {
+                return false;
+            }
+            cursor = gallop(catalog_ids, cursor, book_id);
+            return cursor == catalog_ids.size() || catalog_ids.begin()[cursor] != book_id
+                || removed_catalog_books_.count(book_id) != 0;
+        });
+        ids.erase(kept, ids.end());
+    }
+
+    // Ascending ids of every book, or every available one: stored books come
+    // from the store's bitmaps, the rest from the catalog's rows.
+    std::vector<int> all_book_ids(bool available_only) const {
+        std::vector<int> ids;
+        books_.for_each_id(available_only, [&](int book_id) {
+            ids.push_back(book_id);
+        });
+        std::sort(ids.begin(), ids.end());
+        if (catalog_) {
+            size_t stored_books = ids.size();
+            // Borrowed catalog books are in the store, listed or skipped already.
+            catalog_->for_each_book_id([&](int book_id) {
+                if (!books_.contains(book_id) && removed_catalog_books_.count(book_id) == 0) {
+                    ids.push_back(book_id);
+                }
+            });
+            std::inplace_merge(ids.begin(), ids.begin() + stored_books, ids.end());
+        }
+        return ids;
+    }
+
+    // Needs no book shard: the attribute columns only change under the
+    // exclusive lock, and availability is an atomic bit.
+    bool matches(const BookQuery& query, int book_id) const {
+        if (!has_book(book_id) || (query.available_only && !is_book_available(book_id))) {
+            return false;
+        }
+        auto check = [](const std::optional<std::string>& wanted, Symbol value) {
+            return !wanted || string_pool().str(value) == *wanted;
+        };
+        if (books_.contains(book_id)) {
+            return check(query.author, books_.author(book_id)) && check(query.genre, books_.genre(book_id))
+                && check(query.name, books_.name(book_id));
+        }
+        Book book = catalog_->get(book_id);
+        return check(query.author, book.get_author_symbol()) && check(query.genre, book.get_genre_symbol())
+            && check(query.name, book.get_name_symbol());
+    }
+
+    std::vector<int> next_query_page(QueryPlan& plan, size_t page_size) const {
+        SharedLock tables(tables_mutex_);
+        std::vector<int> page;
+        while (page.size() < page_size && !plan.done()) {
+            int book_id = plan.candidates[plan.position++];
+            if (matches(plan.query, book_id)) {
+                page.push_back(book_id);
+            }
+        }
+        return page;
+    }
+
+    static void erase_from_index(BookIndex& index, Symbol key, int book_id) {
+        auto it = index.find(key);
+        it->second.erase(book_id);
+        if (it->second.empty()) {
+            index.erase(it);
+        }
+    }
+
     Clock<Duration> clock_;
     IdGenerator id_generator_;
-    std::unordered_map<int, std::shared_ptr<User>> id_to_user_;
-    std::unordered_map<int, Book> id_to_book_;
-    std::unordered_map<int, int> books_ownership_; // book_id -> user_id
-    std::unordered_set<std::string> genres_;
-    std::unordered_set<std::string> authors_;
-    std::unordered_map<std::string, std::unordered_set<int>> books_by_author_;
-    std::unordered_map<std::string, std::unordered_set<int>> books_by_genre_;
-    std::unordered_map<std::string, std::unordered_set<int>> books_by_name_;
-    std::deque<std::tuple<int, int, BorrowOperationType>> borrow_history_; // (user_id, book_id, operation_type)
+    UserStore users_;
+    BookStore books_; // also records each loan's owner and due time
+    std::shared_ptr<const CatalogFile> catalog_;
+    std::pmr::unordered_set<int> removed_catalog_books_;
+    std::unordered_map<std::string_view, size_t> removed_catalog_keys_[3]; // per CatalogAttribute: key -> removed books
+    size_t borrowed_catalog_books_ = 0; // catalog books copied into books_ while on loan
+    std::pmr::set<std::pair<std::chrono::system_clock::time_point, int>> loans_by_due_time_; // (due_time, book_id)
+    std::pmr::set<std::pair<std::chrono::system_clock::time_point, int>> penalty_accruals_; // (next day to charge, book_id)
+    std::pmr::unordered_map<int, long long> penalty_exposure_; // user_id -> fines accrued on loans still out
+    long long outstanding_penalties_ = 0; // sum of penalty_exposure_
+    HoldQueues holds_;
+    static_assert(HoldQueues::kPriorities == kUserTypeCount, "one hold priority level per user type");
+    using SubscriberList = std::vector<std::pair<size_t, std::function<void(const AvailabilityEvent&)>>>; // (id, callback)
+    std::shared_ptr<const SubscriberList> subscribers_; // replaced, never changed, so publish can hold on to it; null if empty
+    size_t next_subscription_ = 0;
+    BookIndex books_by_author_; // its keys are the set of all authors
+    BookIndex books_by_genre_; // its keys are the set of all genres
+    BookIndex books_by_name_;
+    TextIndex text_index_; // words of book names and authors
+    bool catalog_text_indexed_ = false;
+    std::vector<int> unindexed_text_books_; // added by add_books() since the last search
+    bool text_index_complete_ = false; // neither of the above is pending
+    BorrowHistory borrow_history_;
+    WriteAheadLog* log_ = nullptr;
+#if LIBRARY_METRICS
+    mutable MetricsRecorder metrics_;
+#endif
+
+    mutable std::shared_mutex tables_mutex_;
+    mutable LockShards book_locks_;
+    mutable LockShards user_locks_;
+    mutable std::mutex holds_mutex_; // guards holds_
+    mutable std::mutex history_mutex_; // guards the due-time and accrual orders, the exposures and borrow_history_
+    mutable std::mutex subscribers_mutex_; // guards subscribers_ and next_subscription_; held only to swap or copy the pointer
 
 };
@@ -1,15 +1,22 @@
 #pragma once
 
 #include "library.h"
+#include "library_persistence.h"
+#include "bulk_import.h"
+#include "console_script.h"
 #include "users.h"
 #include "book.h"
 #include <chrono>
+#include <cstdio>
+#include <deque>
 #include <stdexcept>
 #include <unordered_map>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <optional>
 #include <memory>
+#include <vector>
 #ifdef _WIN32
     #include <windows.h>
 #endif
@@ -20,28 +27,371 @@ struct UserParams {
     int id;
 };
 
+struct ConsoleOptions {
+    std::string catalog_path; // compiled catalog to serve books from, if set
+    std::string data_directory; // keeps the library on disk between runs, if set
+    std::vector<std::string> book_imports; // CSV or JSONL files to bulk-load at startup
+    std::vector<std::string> user_imports;
+    std::string script_path; // runs these commands instead of the menus if set; "-" is stdin
+    bool virtual_time = false; // time stands still except for the script command "advance"
+};
+
 
 
 
 template <typename Duration>
 class LibraryConsole {
 public:
-    LibraryConsole(Duration day_duration) : library_(day_duration) {};
+    LibraryConsole(Duration day_duration, const ConsoleOptions& options = {}) : day_duration_(day_duration), library_(day_duration) {
+        if (options.virtual_time) {
+            virtual_time_ = std::make_unique<VirtualTimeSource>(std::chrono::system_clock::now());
+            library_.set_time_source(virtual_time_.get());
+        }
+        library_.subscribe([this](const AvailabilityEvent& event) { events_.push_back(event); });
+        if (!options.catalog_path.empty()) {
+            library_.open_catalog(options.catalog_path);
+            std::cout << "Opened catalog " << options.catalog_path << " with " << library_.book_count() << " books\n";
+        }
+        if (!options.data_directory.empty()) {
+            restore(options.data_directory);
+        }
+        for (const auto& path : options.book_imports) {
+            report_import("books", path, import_books(library_, path));
+        }
+        for (const auto& path : options.user_imports) {
+            report_import("users", path, import_users(library_, path));
+        }
+    };
 
     void run() {
         #ifdef _WIN32
             SetConsoleCP(1251);
             SetConsoleOutputCP(1251); 
         #endif
-        while (true) {
-            MainMenu();
-            int choice = getUserChoice();
-            handleUserChoice(choice);
+        try {
+            while (running_) {
+                MainMenu();
+                int choice = getUserChoice();
+                handleUserChoice(choice);
+                events_.clear();
+                library_.accrue_penalties();
+                if (persistence_) {
+                    persistence_->maybe_checkpoint();
+                }
+            }
+        } catch (const InputClosed&) {
+        }
+        if (persistence_) {
+            persistence_->sync();
+        }
+    }
+
+    // Non-interactive mode: runs one command per line until the end of input
+    // or "quit", without menus or prompts. Blank lines and lines starting with
+    // '#' are skipped. Words are separated by spaces; quote words that contain
+    // spaces ("War and Peace"), with "" for a literal quote. Commands:
+    //
+    //   add-book <name> <author> <genre>         prints "ok <book id>"
+    //   add-user <student|faculty|guest> <name> <email>   prints "ok <user id>"
+    //   remove-book <book id>, remove-user <user id>
+    //   borrow <user id> <book id>
+    //   return <book id>                         prints "ok <penalty>"
+    //   book <book id>, user <user id>           print the record or "not found"
+    //   books-by-author|books-by-genre|books-by-name <value>
+    //   search <words>                           up to kMaxSearchResults books
+    //   borrowed, overdue, history
+    //   outstanding [user id]                    fines accrued on books still out
+    //   hold <user id> <book id>, cancel-hold <user id> <book id>
+    //   holds <book id>                          prints "ok <holds on the book>"
+    //   watch on|off                             print "event: ..." lines as returned
+    //                                            books become available or go to holders
+    //   import-books <file>, import-users <file> as --import-books/--import-users
+    //   metrics [json]                           Library::metrics() as text or JSON
+    //   advance <days>                           moves virtual time (--virtual-time) forward
+    //   quit
+    //
+    // Fines accrue after every command (Library::accrue_penalties). A command
+    // that fails prints "error: <reason>" instead. Output is buffered
+    // and written in large blocks. Returns the number of failed commands.
+    size_t run_script(std::FILE* input) {
+        ScriptReader reader(input);
+        ScriptOutput out(stdout);
+        std::vector<std::string_view> words;
+        std::deque<std::string> scratch;
+        std::string_view line;
+        size_t failed = 0;
+        while (reader.next_line(line)) {
+            if (!split_command(line, words, scratch)) {
+                out << "error: unterminated quote\n";
+                ++failed;
+                continue;
+            }
+            if (words.empty() || (!words[0].empty() && words[0][0] == '#')) {
+                continue;
+            }
+            if (words[0] == "quit") {
+                break;
+            }
+            if (!runCommand(words, out)) {
+                ++failed;
+            }
+            for (const auto& event : events_) {
+                if (watching_) {
+                    out << "event: book " << event.book_id;
+                    if (event.user_id == BookStore::kNoOwner) {
+                        out << " available\n";
+                    } else {
+                        out << " lent to user " << event.user_id << '\n';
+                    }
+                }
+            }
+            events_.clear();
+            library_.accrue_penalties();
+            if (persistence_) {
+                persistence_->maybe_checkpoint();
+            }
         }
+        out.flush();
+        if (persistence_) {
+            persistence_->sync();
+        }
+        return failed;
     }
 
 private:
+    static constexpr size_t kMaxSearchResults = 50;
+
+    Duration day_duration_;
+    std::unique_ptr<VirtualTimeSource> virtual_time_; // declared first, so it outlives library_
     Library<Duration> library_;
+    std::unique_ptr<LibraryPersistence<Duration>> persistence_;
+    bool running_ = true;
+    std::vector<AvailabilityEvent> events_; // published during the current command
+    bool watching_ = false;
+
+    // Thrown when standard input ends in the middle of the menus.
+    struct InputClosed {};
+
+    // Restores the library from data_directory and logs every later change there.
+    void restore(const std::string& data_directory) {
+        persistence_ = std::make_unique<LibraryPersistence<Duration>>(library_, data_directory);
+        RecoveryStats stats = persistence_->recover();
+        std::cout << "Restored library from " << data_directory << ": "
+                  << (stats.snapshot_loaded ? "snapshot loaded in " + std::to_string(stats.snapshot_load_time.count() / 1000) + " ms, " : "")
+                  << stats.records_replayed << " logged operations replayed in "
+                  << stats.replay_time.count() / 1000 << " ms\n";
+    }
+
+    static void report_import(const char* what, const std::string& path, const ImportStats& stats) {
+        std::cout << "Imported " << stats.imported << " " << what << " from " << path << " in "
+                  << stats.elapsed.count() / 1000 << " ms";
+        if (stats.rejected > 0) {
+            std::cout << ", " << stats.rejected << " lines rejected";
+        }
+        std::cout << "\n";
+        for (const auto& error : stats.errors) {
+            std::cout << "  " << error << "\n";
+        }
+    }
+
+    // Runs one script command; false if it failed.
+    bool runCommand(const std::vector<std::string_view>& words, ScriptOutput& out) {
+        std::string_view command = words[0];
+        auto fail = [&](std::string_view reason) {
+            out << "error: " << reason << '\n';
+            return false;
+        };
+        auto done = [&](LibraryError error) {
+            if (error != LibraryError::NONE) {
+                return fail(error_message(error));
+            }
+            out << "ok\n";
+            return true;
+        };
+        auto print_book = [&](const Book& book) {
+            out << "ID: " << book.get_id() << ", Name: " << book.get_name() << ", Author: " << book.get_author()
+                << ", Genre: " << book.get_genre() << '\n';
+        };
+        auto print_books = [&](const std::vector<Book>& books) {
+            for (const auto& book : books) {
+                print_book(book);
+            }
+            out << "found " << books.size() << '\n';
+            return true;
+        };
+        size_t argument_count = words.size() - 1;
+        int first = 0, second = 0;
+        if (command == "borrow") {
+            if (argument_count != 2 || !parse_int(words[1], first) || !parse_int(words[2], second)) {
+                return fail("usage: borrow <user id> <book id>");
+            }
+            return done(library_.try_borrow_book(first, second));
+        }
+        if (command == "return") {
+            if (argument_count != 1 || !parse_int(words[1], first)) {
+                return fail("usage: return <book id>");
+            }
+            ReturnResult result = library_.try_return_book(first);
+            if (!result.ok()) {
+                return fail(error_message(result.error));
+            }
+            out << "ok " << result.penalty << '\n';
+            return true;
+        }
+        if (command == "add-book") {
+            if (argument_count != 3) {
+                return fail("usage: add-book <name> <author> <genre>");
+            }
+            int id = library_.get_next_book_id();
+            LibraryError error = library_.try_add_book(Book(words[1], words[2], words[3], id));
+            if (error != LibraryError::NONE) {
+                return fail(error_message(error));
+            }
+            out << "ok " << id << '\n';
+            return true;
+        }
+        if (command == "add-user") {
+            std::optional<UserType> type = argument_count == 3 ? user_type_from_name(words[1]) : std::nullopt;
+            if (!type) {
+                return fail("usage: add-user <student|faculty|guest> <name> <email>");
+            }
+            int id = library_.get_next_user_id();
+            LibraryError error = library_.try_add_user(User(*type, words[2], words[3], id));
+            if (error != LibraryError::NONE) {
+                return fail(error_message(error));
+            }
+            out << "ok " << id << '\n';
+            return true;
+        }
+        if (command == "remove-book" || command == "remove-user") {
+            if (argument_count != 1 || !parse_int(words[1], first)) {
+                return fail(command == "remove-book" ? "usage: remove-book <book id>" : "usage: remove-user <user id>");
+            }
+            return done(command == "remove-book" ? library_.try_remove_book(first) : library_.try_remove_user(first));
+        }
+        if (command == "book") {
+            if (argument_count != 1 || !parse_int(words[1], first)) {
+                return fail("usage: book <book id>");
+            }
+            std::optional<Book> book = library_.get_book_by_id(first);
+            if (!book) {
+                return fail("not found");
+            }
+            print_book(*book);
+            return true;
+        }
+        if (command == "user") {
+            if (argument_count != 1 || !parse_int(words[1], first)) {
+                return fail("usage: user <user id>");
+            }
+            std::optional<User> user = library_.get_user_by_id(first);
+            if (!user) {
+                return fail("not found");
+            }
+            out << "ID: " << user->get_id() << ", Name: " << user->get_name() << ", Email: " << user->get_email()
+                << ", Borrowed: " << user->borrowed_count() << ", Penalty: " << user->get_penalty_value() << '\n';
+            return true;
+        }
+        if (command == "books-by-author" || command == "books-by-genre" || command == "books-by-name") {
+            if (argument_count != 1) {
+                return fail("usage: " + std::string(command) + " <value>");
+            }
+            std::string value(words[1]);
+            return print_books(command == "books-by-author" ? library_.get_books_by_author(value)
+                               : command == "books-by-genre" ? library_.get_books_by_genre(value)
+                                                             : library_.get_books_by_name(value));
+        }
+        if (command == "search") {
+            std::string query;
+            for (size_t i = 1; i < words.size(); ++i) {
+                query.append(words[i]).push_back(' ');
+            }
+            return print_books(library_.search_books(query, kMaxSearchResults));
+        }
+        if (command == "borrowed") {
+            for (const Book& book : library_.get_borrowed_books()) {
+                out << "ID: " << book.get_id() << ", Name: " << book.get_name() << '\n';
+            }
+            return true;
+        }
+        if (command == "overdue") {
+            for (int book_id : library_.get_overdue_book_ids()) {
+                out << "ID: " << book_id << '\n';
+            }
+            return true;
+        }
+        if (command == "hold" || command == "cancel-hold") {
+            if (argument_count != 2 || !parse_int(words[1], first) || !parse_int(words[2], second)) {
+                return fail("usage: " + std::string(command) + " <user id> <book id>");
+            }
+            return done(command == "hold" ? library_.try_place_hold(first, second) : library_.try_cancel_hold(first, second));
+        }
+        if (command == "holds") {
+            if (argument_count != 1 || !parse_int(words[1], first)) {
+                return fail("usage: holds <book id>");
+            }
+            out << "ok " << library_.hold_count(first) << '\n';
+            return true;
+        }
+        if (command == "watch") {
+            if (argument_count != 1 || (words[1] != "on" && words[1] != "off")) {
+                return fail("usage: watch on|off");
+            }
+            watching_ = words[1] == "on";
+            out << "ok\n";
+            return true;
+        }
+        if (command == "outstanding") {
+            if (argument_count > 1 || (argument_count == 1 && !parse_int(words[1], first))) {
+                return fail("usage: outstanding [user id]");
+            }
+            out << "ok " << (argument_count == 1 ? library_.penalty_exposure(first) : library_.outstanding_penalties()) << '\n';
+            return true;
+        }
+        if (command == "history") {
+            library_.for_each_borrow_record([&](int user_id, int book_id, BorrowOperationType op_type) {
+                out << "User ID: " << user_id << ", Book ID: " << book_id << ", Operation: "
+                    << (op_type == BorrowOperationType::BORROW ? "BORROW" : "RETURN") << '\n';
+            });
+            return true;
+        }
+        if (command == "import-books" || command == "import-users") {
+            if (argument_count != 1) {
+                return fail("usage: " + std::string(command) + " <file>");
+            }
+            std::string path(words[1]);
+            try {
+                ImportStats stats = command == "import-books" ? import_books(library_, path) : import_users(library_, path);
+                out << "ok " << stats.imported << " imported, " << stats.rejected << " rejected\n";
+                for (const auto& error : stats.errors) {
+                    out << "  " << error << '\n';
+                }
+                return true;
+            } catch (const std::exception& e) {
+                return fail(e.what());
+            }
+        }
+        if (command == "metrics") {
+            if (argument_count > 1 || (argument_count == 1 && words[1] != "json")) {
+                return fail("usage: metrics [json]");
+            }
+            MetricsSnapshot snapshot = library_.metrics();
+            out << (argument_count == 1 ? snapshot.to_json() + "\n" : snapshot.to_text());
+            return true;
+        }
+        if (command == "advance") {
+            if (argument_count != 1 || !parse_int(words[1], first) || first < 0) {
+                return fail("usage: advance <days>");
+            }
+            if (!virtual_time_) {
+                return fail("advance needs --virtual-time");
+            }
+            virtual_time_->advance(first * day_duration_);
+            out << "ok\n";
+            return true;
+        }
+        return fail("unknown command " + std::string(command));
+    }
 
     void MainMenu() {
         std::cout << "=== Library Management ===\n";
@@ -55,7 +405,9 @@ private:
         std::string input;
         while (true) {
             std::cout << prompt;
-            std::getline(std::cin, input);
+            if (!std::getline(std::cin, input)) {
+                throw InputClosed{};
+            }
             try {
                 return std::stoi(input);
             } catch (const std::exception&) {
@@ -70,8 +422,10 @@ private:
         std::string input;
         while (true) {
             std::cout << prompt;
-            std::getline(std::cin, input);
-            
+            if (!std::getline(std::cin, input)) {
+                throw InputClosed{};
+            }
+
             input.erase(0, input.find_first_not_of(" \t\n\r"));
             input.erase(input.find_last_not_of(" \t\n\r") + 1);
             
@@ -108,7 +462,8 @@ private:
             break;
         case 4:
             std::cout << "Exiting...\n";
-            exit(0);
+            running_ = false;
+            break;
         default:
             std::cout << "Invalid choice. Please try again.\n";
         }
@@ -125,7 +480,8 @@ private:
         std::cout << "7. View Books by Genre\n";
         std::cout << "8. View All Genres\n";
         std::cout << "9. View All Authors\n";
-        std::cout << "10. Back to Main Menu\n";
+        std::cout << "10. Search Books by Words\n";
+        std::cout << "11. Back to Main Menu\n";
     }
 
     void handleBookManagementChoice(int choice) {
@@ -159,6 +515,9 @@ private:
                 getAllAuthors();
                 break;
             case 10:
+                searchBooksByWords();
+                break;
+            case 11:
                 return;
             default:
                 std::cout << "Invalid choice. Please try again.\n";
@@ -201,11 +560,10 @@ private:
 
     void viewAllBooks() {
         std::cout << "=== All Books ===\n";
-        for (const auto& pair : library_.get_all_books()) {
-            const Book& book = pair.second;
+        library_.for_each_book([](const Book& book) {
             std::cout << "ID: " << book.get_id() << ", Name: " << book.get_name()
                       << ", Author: " << book.get_author() << ", Genre: " << book.get_genre() << "\n";
-        }
+        });
     }
 
     void searchBookByID() {
@@ -241,6 +599,32 @@ private:
         }
     }
 
+    void searchBooksByWords() {
+        std::string query = getValidString("Enter words from the name or author: ");
+        try {
+            auto books = library_.search_books(query, kMaxSearchResults);
+            if (books.empty()) {
+                std::cout << "No books found for: " << query << "\n";
+                std::string last_word = query.substr(query.find_last_of(' ') + 1);
+                auto words = library_.complete_search_word(last_word, 10);
+                if (!words.empty()) {
+                    std::cout << "Words starting with \"" << last_word << "\":";
+                    for (const auto& word : words) {
+                        std::cout << " " << word;
+                    }
+                    std::cout << "\n";
+                }
+                return;
+            }
+            for (const auto& book : books) {
+                std::cout << "ID: " << book.get_id() << ", Name: " << book.get_name()
+                        << ", Author: " << book.get_author() << ", Genre: " << book.get_genre() << "\n";
+            }
+        } catch (const std::exception& e) {
+            std::cout << "Error searching book: " << e.what() << "\n";
+        }
+    }
+
     void searchBookByAuthor() {
         std::string author = getValidString("Enter author name to search: ");
         try {
@@ -276,19 +660,17 @@ private:
     }
 
     void getAllGenres() {
-        auto genres = library_.get_all_genres();
         std::cout << "=== All Genres ===\n";
-        for (const auto& genre : genres) {
+        library_.for_each_genre([](std::string_view genre) {
             std::cout << genre << "\n";
-        }
+        });
     }
 
     void getAllAuthors() {
-        auto authors = library_.get_all_authors();
         std::cout << "=== All Authors ===\n";
-        for (const auto& author : authors) {
+        library_.for_each_author([](std::string_view author) {
             std::cout << author << "\n";
-        }
+        });
     }
 
 
@@ -375,9 +757,8 @@ private:
 
 
     void addFaculty(UserParams params) {
-        Faculty new_faculty(params.name, params.email, params.id);
         try {
-            library_.add_user(std::make_shared<Faculty>(new_faculty));
+            library_.add_user(Faculty(params.name, params.email, params.id));
             std::cout << "Faculty added successfully.\n";
         } catch (const std::exception& e) {
             std::cout << "Error adding faculty: " << e.what() << "\n";
@@ -386,9 +767,8 @@ private:
     }
 
     void addGuest(UserParams params) {
-        Guest new_guest(params.name, params.email, params.id);
         try {
-            library_.add_user(std::make_shared<Guest>(new_guest));
+            library_.add_user(Guest(params.name, params.email, params.id));
             std::cout << "Guest added successfully.\n";
         } catch (const std::exception& e) {
             std::cout << "Error adding guest: " << e.what() << "\n";
@@ -397,9 +777,8 @@ private:
     }
 
     void addStudent(UserParams params) {
-        Student new_student(params.name, params.email, params.id);
         try {
-            library_.add_user(std::make_shared<Student>(new_student));
+            library_.add_user(Student(params.name, params.email, params.id));
             std::cout << "Student added successfully.\n";
         } catch (const std::exception& e) {
             std::cout << "Error adding student: " << e.what() << "\n";
@@ -421,11 +800,10 @@ private:
     }
 
     void viewAllUsers() {
-        auto users = library_.get_all_users();
         std::cout << "=== All Users ===\n";
-        for (const auto& [id, user] : users) {
-            std::cout << "User: " << user->get_name() << " email: " << user->get_email() << " has " << user->get_borrowed_books().size() << " borrowed books with penalty: " << user->get_penalty_value() << " (ID: " << id << ")\n";
-        }
+        library_.for_each_user([](const User& user) {
+            std::cout << "User: " << user.get_name() << " email: " << user.get_email() << " has " << user.borrowed_count() << " borrowed books with penalty: " << user.get_penalty_value() << " (ID: " << user.get_id() << ")\n";
+        });
     }
 
     void searchUserById() {
@@ -433,7 +811,7 @@ private:
         id = getUserInt("Enter user ID to search: ");
         auto user = library_.get_user_by_id(id);
         if (user) {
-            std::cout << "Found User: " << user->get_name() << " email: " << user->get_email() << " has " << user->get_borrowed_books().size() << " borrowed books with penalty: " << user->get_penalty_value() << " (ID: " << id << ")\n";
+            std::cout << "Found User: " << user->get_name() << " email: " << user->get_email() << " has " << user->borrowed_count() << " borrowed books with penalty: " << user->get_penalty_value() << " (ID: " << id << ")\n";
         } else {
             std::cout << "User not found.\n";
         }
@@ -447,7 +825,9 @@ private:
         std::cout << "3. View Borrowed Operations\n";
         std::cout << "4. Get Borrowed Books\n";
         std::cout << "5. Get Overdue Books\n";
-        std::cout << "6. Back to Main Menu\n";
+        std::cout << "6. Place Hold\n";
+        std::cout << "7. Cancel Hold\n";
+        std::cout << "8. Back to Main Menu\n";
     }
 
 
@@ -470,6 +850,12 @@ private:
                 viewOverdueBooks();
                 break;
             case 6:
+                placeHold();
+                break;
+            case 7:
+                cancelHold();
+                break;
+            case 8:
                 return;
             default:
                 std::cout << "Invalid choice. Please try again.\n";
@@ -496,6 +882,7 @@ private:
     void returnBook() {
         int book_id;
         book_id = getUserInt("Enter book ID to return: ");
+        events_.clear();
         try {
             int penalty = library_.return_book(book_id);
             if (penalty > 0) {
@@ -503,22 +890,46 @@ private:
             } else {
                 std::cout << "Book returned successfully with no penalty.\n";
             }
+            for (const auto& event : events_) {
+                if (event.user_id != BookStore::kNoOwner) {
+                    std::cout << "Book lent to user " << event.user_id << ", who had it on hold.\n";
+                }
+            }
         } catch (const std::exception& e) {
             std::cout << "Error returning book: " << e.what() << "\n";
         }
     }
 
 
+    void placeHold() {
+        int user_id = getUserInt("Enter user ID: ");
+        int book_id = getUserInt("Enter book ID: ");
+        try {
+            library_.place_hold(user_id, book_id);
+            std::cout << "Hold placed, position " << library_.hold_position(user_id, book_id) << " in line.\n";
+        } catch (const std::exception& e) {
+            std::cout << "Error placing hold: " << e.what() << "\n";
+        }
+    }
+
+    void cancelHold() {
+        int user_id = getUserInt("Enter user ID: ");
+        int book_id = getUserInt("Enter book ID: ");
+        try {
+            library_.cancel_hold(user_id, book_id);
+            std::cout << "Hold cancelled.\n";
+        } catch (const std::exception& e) {
+            std::cout << "Error cancelling hold: " << e.what() << "\n";
+        }
+    }
+
+
     void viewAllBorrowedOperations() {
-        auto history = library_.get_borrow_history();
-        std::cout << "=== Borrowed Operations(from newest to oldest) ===\n";
-        for (const auto& record : history) {
-            int user_id, book_id;
-            BorrowOperationType op_type;
-            std::tie(user_id, book_id, op_type) = record;
-            std::string operation = (op_type == BorrowOperationType::BORROW) ? "BORROW" : "RETURN";
+        std::cout << "=== Borrowed Operations(from oldest to newest) ===\n";
+        library_.for_each_borrow_record([](int user_id, int book_id, BorrowOperationType op_type) {
+            const char* operation = (op_type == BorrowOperationType::BORROW) ? "BORROW" : "RETURN";
             std::cout << "User ID: " << user_id << ", Book ID: " << book_id << ", Operation: " << operation << "\n";
-        }
+        });
     }
 
 
@@ -530,10 +941,11 @@ private:
     }
 
     void viewOverdueBooks() {
-        std::set<Book> overdue_books = library_.get_overdue_books();
-        for (auto book: overdue_books) {
-            std::cout << "ID: " << book.get_id() << ", Name: " << book.get_name() << "\n";
+        for (int book_id : library_.get_overdue_book_ids()) {
+            std::optional<Book> book = library_.get_book_by_id(book_id);
+            std::cout << "ID: " << book_id << ", Name: " << book->get_name() << "\n";
         }
+        std::cout << "Fines accrued on books still out: " << library_.outstanding_penalties() << "\n";
     }
 
 };
\ No newline at end of file
@@ -0,0 +1,290 @@
+#pragma once
+#include "bits.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Library records metrics unless built with -DLIBRARY_METRICS=0, which
+// removes the recorder and every probe.
+#ifndef LIBRARY_METRICS
+    #define LIBRARY_METRICS 1
+#endif
+
+
+enum class LibraryOperation {
+    ADD_USER,
+    ADD_BOOK,
+    REMOVE_USER,
+    REMOVE_BOOK,
+    BORROW_BOOK,
+    RETURN_BOOK,
+    ADD_PENALTY,
+    BORROW_BOOKS,
+    RETURN_BOOKS,
+    GET_BORROWED_BOOKS,
+    GET_OVERDUE_BOOKS,
+    SEARCH_BOOKS,
+    PLACE_HOLD,
+    CANCEL_HOLD,
+    GET_OVERDUE_BOOK_IDS,
+    ACCRUE_PENALTIES
+};
+
+constexpr size_t kLibraryOperationCount = 16;
+
+inline const char* operation_name(LibraryOperation operation) {
+    switch (operation) {
+    case LibraryOperation::ADD_USER: return "add_user";
+    case LibraryOperation::ADD_BOOK: return "add_book";
+    case LibraryOperation::REMOVE_USER: return "remove_user";
+    case LibraryOperation::REMOVE_BOOK: return "remove_book";
+    case LibraryOperation::BORROW_BOOK: return "borrow_book";
+    case LibraryOperation::RETURN_BOOK: return "return_book";
+    case LibraryOperation::ADD_PENALTY: return "add_penalty";
+    case LibraryOperation::BORROW_BOOKS: return "borrow_books";
+    case LibraryOperation::RETURN_BOOKS: return "return_books";
+    case LibraryOperation::GET_BORROWED_BOOKS: return "get_borrowed_books";
+    case LibraryOperation::GET_OVERDUE_BOOKS: return "get_overdue_books";
+    case LibraryOperation::SEARCH_BOOKS: return "search_books";
+    case LibraryOperation::PLACE_HOLD: return "place_hold";
+    case LibraryOperation::CANCEL_HOLD: return "cancel_hold";
+    case LibraryOperation::GET_OVERDUE_BOOK_IDS: return "get_overdue_book_ids";
+    case LibraryOperation::ACCRUE_PENALTIES: return "accrue_penalties";
+    }
+    return "unknown";
+}
+
+
+// Log-linear latency buckets, as in HdrHistogram: values below 16 ns get a
+// bucket each, and every power of two above is split into 16 equal buckets,
+// so a bucket is never wider than 1/16 of its values (one significant hex
+// digit). Values from 2^kMaxExponent ns (about 18 minutes) up share the last
+// bucket.
+struct LatencyBuckets {
+    static constexpr int kSubBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBits;
+    static constexpr int kMaxExponent = 40;
+    static constexpr size_t kCount = kSubBuckets + (kMaxExponent - kSubBits) * kSubBuckets;
+
+    static size_t index_of(std::uint64_t ns) {
+        if (ns < kSubBuckets) {
+            return static_cast<size_t>(ns);
+        }
+        int exponent = 63 - count_leading_zeros(ns);
+        if (exponent >= kMaxExponent) {
+            return kCount - 1;
+        }
+        size_t mantissa = static_cast<size_t>(ns >> (exponent - kSubBits)) & (kSubBuckets - 1);
+        return kSubBuckets + static_cast<size_t>(exponent - kSubBits) * kSubBuckets + mantissa;
+    }
+
+    // Smallest and largest value that fall into the bucket.
+    static std::uint64_t lowest(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        size_t exponent = (index - kSubBuckets) / kSubBuckets + kSubBits;
+        size_t mantissa = (index - kSubBuckets) % kSubBuckets;
+        return (std::uint64_t{kSubBuckets} + mantissa) << (exponent - kSubBits);
+    }
+
+    static std::uint64_t highest(size_t index) {
+        return index + 1 < kCount ? lowest(index + 1) - 1 : lowest(index);
+    }
+};
+
+
+// Merged view of the recorded operations, see Library::metrics().
+struct OperationStats {
+    const char* name = "";
+    std::uint64_t calls = 0;
+    std::uint64_t items = 0; // per result below; batch calls count their items
+    std::vector<std::pair<std::string, std::uint64_t>> failures; // reason -> items, non-zero only
+    double mean_ns = 0;
+    std::uint64_t p50_ns = 0, p90_ns = 0, p99_ns = 0, p999_ns = 0, max_ns = 0;
+};
+
+struct MetricsSnapshot {
+    bool enabled = LIBRARY_METRICS != 0;
+    std::vector<OperationStats> operations; // only operations that were called
+
+    std::string to_text() const {
+        std::string out;
+        char line[256];
+        if (!enabled) {
+            return "metrics disabled at compile time\n";
+        }
+        for (const auto& op : operations) {
+            std::snprintf(line, sizeof(line),
+                          "%-20s calls %llu, items %llu, mean %.0f ns, p50 %llu, p90 %llu, p99 %llu, p999 %llu, max %llu ns\n",
+                          op.name, as_ull(op.calls), as_ull(op.items), op.mean_ns, as_ull(op.p50_ns), as_ull(op.p90_ns),
+                          as_ull(op.p99_ns), as_ull(op.p999_ns), as_ull(op.max_ns));
+            out += line;
+            for (const auto& [reason, count] : op.failures) {
+                out += "    " + reason + ": " + std::to_string(count) + "\n";
+            }
+        }
+        return out;
+    }
+
+    std::string to_json() const {
+        std::string out = "{\"enabled\":";
+        out += enabled ? "true" : "false";
+        out += ",\"operations\":{";
+        char fields[256];
+        for (size_t i = 0; i < operations.size(); ++i) {
+            const auto& op = operations[i];
+            std::snprintf(fields, sizeof(fields),
+                          "\"calls\":%llu,\"items\":%llu,\"mean_ns\":%.0f,\"p50_ns\":%llu,\"p90_ns\":%llu,"
+                          "\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu",
+                          as_ull(op.calls), as_ull(op.items), op.mean_ns, as_ull(op.p50_ns), as_ull(op.p90_ns),
+                          as_ull(op.p99_ns), as_ull(op.p999_ns), as_ull(op.max_ns));
+            out += (i ? ",\"" : "\"") + std::string(op.name) + "\":{" + fields + ",\"failures\":{";
+            for (size_t j = 0; j < op.failures.size(); ++j) {
+                out += (j ? ",\"" : "\"") + op.failures[j].first + "\":" + std::to_string(op.failures[j].second);
+            }
+            out += "}}";
+        }
+        return out + "}}";
+    }
+
+private:
+    static unsigned long long as_ull(std::uint64_t value) { return static_cast<unsigned long long>(value); }
+};
+
+
+// Counters and latency histograms of every LibraryOperation. Recording is
+// lock-free: each thread writes to one of kStripes stripes (allocated on
+// first use, so a single-threaded library carries one), with relaxed atomic
+// increments that stay on that thread's cache lines unless more than kStripes
+// threads share the library. Reading merges the stripes; it sees each counter
+// at some recent value, not a single instant across all of them.
+class MetricsRecorder {
+public:
+    static constexpr size_t kStripes = 8;
+    static constexpr size_t kMaxResults = 32; // result codes 0 (success) .. 31
+
+    MetricsRecorder() = default;
+    MetricsRecorder(const MetricsRecorder&) = delete;
+    MetricsRecorder& operator=(const MetricsRecorder&) = delete;
+
+    ~MetricsRecorder() {
+        for (auto& stripe : stripes_) {
+            delete stripe.load(std::memory_order_relaxed);
+        }
+    }
+
+    // One call that took ns and produced the result codes of its items.
+    template <typename Codes>
+    void record(LibraryOperation operation, std::uint64_t ns, const Codes& codes) {
+        Counters& counters = stripe().operations[static_cast<size_t>(operation)];
+        counters.total_ns.fetch_add(ns, std::memory_order_relaxed);
+        counters.latency[LatencyBuckets::index_of(ns)].fetch_add(1, std::memory_order_relaxed);
+        std::uint64_t max = counters.max_ns.load(std::memory_order_relaxed);
+        while (ns > max && !counters.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+        codes([&](std::uint8_t code) {
+            counters.results[code < kMaxResults ? code : kMaxResults - 1].fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    // result_name(code) names the failure codes 1 .. kMaxResults - 1.
+    template <typename ResultName>
+    MetricsSnapshot snapshot(ResultName&& result_name) const {
+        MetricsSnapshot snapshot;
+        for (size_t op = 0; op < kLibraryOperationCount; ++op) {
+            std::uint64_t total_ns = 0, max_ns = 0;
+            std::array<std::uint64_t, kMaxResults> results{};
+            std::vector<std::uint64_t> latency(LatencyBuckets::kCount, 0);
+            for (const auto& pointer : stripes_) {
+                const Stripe* stripe = pointer.load(std::memory_order_acquire);
+                if (stripe == nullptr) {
+                    continue;
+                }
+                const Counters& counters = stripe->operations[op];
+                total_ns += counters.total_ns.load(std::memory_order_relaxed);
+                max_ns = std::max(max_ns, counters.max_ns.load(std::memory_order_relaxed));
+                for (size_t code = 0; code < kMaxResults; ++code) {
+                    results[code] += counters.results[code].load(std::memory_order_relaxed);
+                }
+                for (size_t bucket = 0; bucket < LatencyBuckets::kCount; ++bucket) {
+                    latency[bucket] += counters.latency[bucket].load(std::memory_order_relaxed);
+                }
+            }
+            // Every call lands in one latency bucket, so they count the calls.
+            // The buckets are read one by one and may be a little ahead of
+            // total_ns and the result counters.
+            std::uint64_t calls = 0;
+            for (std::uint64_t count : latency) {
+                calls += count;
+            }
+            if (calls == 0) {
+                continue;
+            }
+            OperationStats stats;
+            stats.name = operation_name(static_cast<LibraryOperation>(op));
+            stats.calls = calls;
+            for (size_t code = 0; code < kMaxResults; ++code) {
+                stats.items += results[code];
+                if (code != 0 && results[code] != 0) {
+                    stats.failures.emplace_back(result_name(static_cast<std::uint8_t>(code)), results[code]);
+                }
+            }
+            stats.mean_ns = static_cast<double>(total_ns) / static_cast<double>(calls);
+            stats.max_ns = max_ns;
+            auto percentile = [&](double fraction) {
+                // Nearest rank: the smallest value with at least this fraction of samples at or below it.
+                std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(fraction * static_cast<double>(calls))));
+                std::uint64_t seen = 0;
+                for (size_t bucket = 0; bucket < LatencyBuckets::kCount; ++bucket) {
+                    seen += latency[bucket];
+                    if (seen >= rank) {
+                        return std::min(LatencyBuckets::highest(bucket), max_ns);
+                    }
+                }
+                return max_ns;
+            };
+            stats.p50_ns = percentile(0.5);
+            stats.p90_ns = percentile(0.9);
+            stats.p99_ns = percentile(0.99);
+            stats.p999_ns = percentile(0.999);
+            snapshot.operations.push_back(std::move(stats));
+        }
+        return snapshot;
+    }
+
+private:
+    struct Counters {
+        std::atomic<std::uint64_t> total_ns{0};
+        std::atomic<std::uint64_t> max_ns{0};
+        std::array<std::atomic<std::uint64_t>, kMaxResults> results{};
+        std::array<std::atomic<std::uint64_t>, LatencyBuckets::kCount> latency{};
+    };
+
+    struct alignas(64) Stripe {
+        std::array<Counters, kLibraryOperationCount> operations;
+    };
+
+    Stripe& stripe() {
+        static std::atomic<size_t> next_thread{0};
+        thread_local const size_t index = next_thread.fetch_add(1, std::memory_order_relaxed) % kStripes;
+        Stripe* stripe = stripes_[index].load(std::memory_order_acquire);
+        if (stripe == nullptr) {
+            Stripe* fresh = new Stripe();
+            if (stripes_[index].compare_exchange_strong(stripe, fresh, std::memory_order_acq_rel)) {
+                stripe = fresh;
+            } else {
+                delete fresh; // another thread of this stripe got there first
+            }
+        }
+        return *stripe;
+    }
+
+    std::array<std::atomic<Stripe*>, kStripes> stripes_{};
+};
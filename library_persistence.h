@@ -0,0 +1,368 @@
+#pragma once
+#include "library.h"
+#include "write_ahead_log.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+
+struct PersistenceOptions {
+    WalOptions wal;
+    // maybe_checkpoint() writes a snapshot once this many records were logged
+    // since the last one, which bounds how much log recovery has to replay.
+    std::uint64_t snapshot_every = 100000;
+};
+
+
+struct RecoveryStats {
+    bool snapshot_loaded = false;
+    std::uint64_t snapshot_lsn = 0;
+    std::uint64_t records_replayed = 0;
+    std::chrono::microseconds snapshot_load_time{0};
+    std::chrono::microseconds replay_time{0};
+};
+
+
+// Durable storage for a Library in a directory holding two files:
+//   snapshot.bin  full library state as of some LSN (log sequence number)
+//   log.bin       write-ahead log of every mutation since (at most) that LSN
+//
+// recover() loads the snapshot, replays the log records it does not cover
+// and then attaches the log to the library. checkpoint() writes a new
+// snapshot and starts an empty log; a crash between the two steps is harmless
+// because replay skips records the snapshot already contains.
+//
+// recover() must finish before the library is shared between threads;
+// checkpoint() holds the library's exclusive lock while it runs. A
+// library that serves a compiled catalog must open it before recover(); the
+// snapshot only stores what was changed on top of the catalog.
+template <typename Duration>
+class LibraryPersistence {
+public:
+    LibraryPersistence(Library<Duration>& library, std::string directory, PersistenceOptions options = {})
+        : library_(library), directory_(std::move(directory)), options_(options) {}
+
+    LibraryPersistence(const LibraryPersistence&) = delete;
+    LibraryPersistence& operator=(const LibraryPersistence&) = delete;
+
+    ~LibraryPersistence() {
+        library_.attach_log(nullptr);
+    }
+
+    // Expects an empty library.
+    RecoveryStats recover() {
+        RecoveryStats stats;
+        std::filesystem::create_directories(directory_);
+
+        auto started = std::chrono::steady_clock::now();
+        if (std::filesystem::exists(snapshot_path())) {
+            snapshot_lsn_ = load_snapshot();
+            stats.snapshot_loaded = true;
+            stats.snapshot_lsn = snapshot_lsn_;
+        }
+        auto snapshot_loaded = std::chrono::steady_clock::now();
+
+        std::uint64_t next_lsn = snapshot_lsn_;
+        if (std::filesystem::exists(log_path())) {
+            WalReader reader(log_path());
+            if (reader.base_lsn() > snapshot_lsn_) {
+                throw PersistenceException("Log does not continue the snapshot in " + directory_);
+            }
+            WalRecord record;
+            while (true) {
+                std::uint64_t lsn = reader.next_lsn();
+                if (!reader.next(record)) {
+                    break;
+                }
+                if (lsn >= snapshot_lsn_) {
+                    replay(record);
+                    ++stats.records_replayed;
+                }
+            }
+            next_lsn = std::max(next_lsn, reader.next_lsn());
+            // Drop a torn tail left by a crash so new records follow valid ones.
+            if (std::filesystem::file_size(log_path()) != reader.valid_size()) {
+                std::filesystem::resize_file(log_path(), reader.valid_size());
+            }
+        } else {
+            WriteAheadLog::create(log_path(), snapshot_lsn_);
+        }
+        auto replayed = std::chrono::steady_clock::now();
+
+        stats.snapshot_load_time = std::chrono::duration_cast<std::chrono::microseconds>(snapshot_loaded - started);
+        stats.replay_time = std::chrono::duration_cast<std::chrono::microseconds>(replayed - snapshot_loaded);
+
+        log_ = std::make_unique<WriteAheadLog>(log_path(), next_lsn, options_.wal);
+        library_.attach_log(log_.get());
+        return stats;
+    }
+
+    void sync() {
+        if (log_) log_->sync();
+    }
+
+    void checkpoint() {
+        std::unique_lock<std::shared_mutex> tables(library_.tables_mutex_);
+        log_->sync();
+        std::uint64_t lsn = log_->next_lsn();
+        {
+            // The history and the exposures are also reached without the
+            // tables lock, e.g. by set_history_retention; last in the lock order.
+            std::lock_guard<std::mutex> history(library_.history_mutex_);
+            write_snapshot(lsn);
+        }
+        snapshot_lsn_ = lsn;
+
+        library_.log_ = nullptr;
+        log_.reset();
+        std::string fresh_log = log_path() + ".tmp";
+        WriteAheadLog::create(fresh_log, lsn);
+        std::filesystem::rename(fresh_log, log_path());
+        sync_directory();
+        log_ = std::make_unique<WriteAheadLog>(log_path(), lsn, options_.wal);
+        library_.log_ = log_.get();
+    }
+
+    bool maybe_checkpoint() {
+        if (log_->next_lsn() - snapshot_lsn_ < options_.snapshot_every) {
+            return false;
+        }
+        checkpoint();
+        return true;
+    }
+
+private:
+    static constexpr std::string_view kSnapshotMagic = "LIBSNAP2";
+
+    std::string snapshot_path() const { return directory_ + "/snapshot.bin"; }
+
+    std::string log_path() const { return directory_ + "/log.bin"; }
+
+    void replay(const WalRecord& record) {
+        switch (record.type) {
+        case WalRecordType::ADD_USER:
+            library_.add_user(make_user(record.user_type, record.name, record.email, record.user_id));
+            break;
+        case WalRecordType::ADD_BOOK:
+            library_.add_book(Book(record.name, record.author, record.genre, record.book_id));
+            break;
+        case WalRecordType::REMOVE_USER:
+            library_.remove_user(record.user_id);
+            break;
+        case WalRecordType::REMOVE_BOOK:
+            library_.remove_book(record.book_id);
+            break;
+        case WalRecordType::BORROW:
+            library_.borrow_book_at(record.user_id, record.book_id, record.time);
+            break;
+        case WalRecordType::RETURN:
+            if (!library_.books_.contains(record.book_id) || library_.books_.owner(record.book_id) == BookStore::kNoOwner) {
+                throw PersistenceException("Log returns a book that is not borrowed");
+            }
+            library_.finish_return(record.book_id, record.amount, record.time);
+            break;
+        case WalRecordType::ADD_PENALTY:
+            library_.add_penalty(record.user_id, record.amount);
+            break;
+        }
+    }
+
+    // Layout: magic, fixed64 LSN, body, fixed32(checksum32(body)).
+    // Book strings go into a table first so each distinct string is written once.
+    // Runs under the library's exclusive lock and history_mutex_, so it reads
+    // the tables directly.
+    void write_snapshot(std::uint64_t lsn) {
+        std::string body;
+        BinaryWriter out(body);
+        out.varint(static_cast<std::uint64_t>(library_.id_generator_.peek_next_id()));
+
+        out.varint(library_.users_.size());
+        library_.users_.for_each([&](const User& user) {
+            out.svarint(user.get_id());
+            out.u8(static_cast<std::uint8_t>(user.get_user_type()));
+            out.str(user.get_name());
+            out.str(user.get_email());
+            // Fines accrued on loans still out are charged again by the first
+            // accrue_penalties() after a restore.
+            auto exposure = library_.penalty_exposure_.find(user.get_id());
+            out.svarint(user.get_penalty_value() - (exposure == library_.penalty_exposure_.end() ? 0 : exposure->second));
+        });
+
+        // Removed catalog books come before added books, which may reuse their ids.
+        out.varint(library_.removed_catalog_books_.size());
+        for (int book_id : library_.removed_catalog_books_) {
+            out.svarint(book_id);
+        }
+
+        std::unordered_map<Symbol, std::uint64_t> string_index;
+        std::vector<Symbol> strings;
+        auto index_of = [&](Symbol symbol) {
+            auto [it, inserted] = string_index.emplace(symbol, strings.size());
+            if (inserted) {
+                strings.push_back(symbol);
+            }
+            return it->second;
+        };
+        std::string books;
+        BinaryWriter books_out(books);
+        std::uint64_t book_count = 0;
+        library_.books_.for_each([&](const Book& book) {
+            if (library_.is_catalog_book(book.get_id())) {
+                return;
+            }
+            books_out.svarint(book.get_id());
+            books_out.varint(index_of(book.get_name_symbol()));
+            books_out.varint(index_of(book.get_author_symbol()));
+            books_out.varint(index_of(book.get_genre_symbol()));
+            ++book_count;
+        });
+        out.varint(strings.size());
+        for (Symbol symbol : strings) {
+            out.str(string_pool().str(symbol));
+        }
+        out.varint(book_count);
+        body += books;
+
+        std::string loans;
+        BinaryWriter loans_out(loans);
+        std::uint64_t loan_count = 0;
+        library_.books_.for_each_borrowed([&](int book_id, int user_id, std::chrono::system_clock::time_point taken_time) {
+            loans_out.svarint(book_id);
+            loans_out.svarint(user_id);
+            loans_out.time(taken_time);
+            ++loan_count;
+        });
+        out.varint(loan_count);
+        body += loans;
+
+        out.varint(library_.borrow_history_.size());
+        library_.borrow_history_.for_each([&](const BorrowEvent& event) {
+            out.svarint(event.user_id);
+            out.svarint(event.book_id);
+            out.u8(static_cast<std::uint8_t>(event.op_type));
+            out.time(event.time);
+        });
+
+        std::string file_data(kSnapshotMagic);
+        BinaryWriter header(file_data);
+        header.fixed64(lsn);
+        file_data += body;
+        header.fixed32(checksum32(body));
+
+        std::string tmp_path = snapshot_path() + ".tmp";
+        std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+        if (file == nullptr) {
+            throw PersistenceException("Cannot create snapshot " + tmp_path);
+        }
+        bool written = std::fwrite(file_data.data(), 1, file_data.size(), file) == file_data.size();
+        try {
+            sync_file(file);
+        } catch (const PersistenceException&) {
+            written = false;
+        }
+        std::fclose(file);
+        if (!written) {
+            throw PersistenceException("Cannot write snapshot " + tmp_path);
+        }
+        std::filesystem::rename(tmp_path, snapshot_path());
+        sync_directory();
+    }
+
+    // Returns the LSN the snapshot was taken at.
+    std::uint64_t load_snapshot() {
+        std::ifstream file(snapshot_path(), std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        size_t header_size = kSnapshotMagic.size() + 8;
+        if (data.size() < header_size + 4 || std::string_view(data).substr(0, kSnapshotMagic.size()) != kSnapshotMagic) {
+            throw PersistenceException("Not a library snapshot: " + snapshot_path());
+        }
+        std::string_view body = std::string_view(data).substr(header_size, data.size() - header_size - 4);
+        BinaryReader header(std::string_view(data).substr(kSnapshotMagic.size()));
+        std::uint64_t lsn = header.fixed64();
+        BinaryReader trailer(std::string_view(data).substr(data.size() - 4));
+        if (trailer.fixed32() != checksum32(body)) {
+            throw PersistenceException("Corrupted snapshot: " + snapshot_path());
+        }
+
+        BinaryReader in(body);
+        int next_id = static_cast<int>(in.varint());
+
+        for (std::uint64_t count = in.varint(); count > 0; --count) {
+            int id = static_cast<int>(in.svarint());
+            auto type = static_cast<UserType>(in.u8());
+            std::string_view name = in.str();
+            std::string_view email = in.str();
+            int penalty = static_cast<int>(in.svarint());
+            User user = make_user(type, name, email, id);
+            user.add_penalty(penalty);
+            library_.add_user(user);
+        }
+
+        for (std::uint64_t count = in.varint(); count > 0; --count) {
+            library_.remove_book(static_cast<int>(in.svarint()));
+        }
+
+        std::vector<Symbol> strings(in.varint());
+        for (Symbol& symbol : strings) {
+            symbol = string_pool().intern(in.str());
+        }
+        auto string_at = [&](std::uint64_t index) {
+            if (index >= strings.size()) {
+                throw PersistenceException("Corrupted snapshot: bad string index");
+            }
+            return strings[index];
+        };
+        for (std::uint64_t count = in.varint(); count > 0; --count) {
+            int id = static_cast<int>(in.svarint());
+            Symbol name = string_at(in.varint());
+            Symbol author = string_at(in.varint());
+            Symbol genre = string_at(in.varint());
+            library_.add_book(Book(name, author, genre, id));
+        }
+
+        for (std::uint64_t count = in.varint(); count > 0; --count) {
+            int book_id = static_cast<int>(in.svarint());
+            int user_id = static_cast<int>(in.svarint());
+            library_.borrow_book_at(user_id, book_id, in.time());
+        }
+
+        library_.borrow_history_.clear();
+        for (std::uint64_t count = in.varint(); count > 0; --count) {
+            int user_id = static_cast<int>(in.svarint());
+            int book_id = static_cast<int>(in.svarint());
+            auto op_type = static_cast<BorrowOperationType>(in.u8());
+            auto time = in.time();
+            library_.borrow_history_.append({user_id, book_id, op_type, time});
+        }
+
+        library_.id_generator_.reserve(next_id - 1);
+        return lsn;
+    }
+
+    // Makes renames inside the directory durable.
+    void sync_directory() const {
+#ifndef _WIN32
+        int fd = ::open(directory_.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+#endif
+    }
+
+    Library<Duration>& library_;
+    std::string directory_;
+    PersistenceOptions options_;
+    std::uint64_t snapshot_lsn_ = 0;
+    std::unique_ptr<WriteAheadLog> log_;
+};
@@ -1,12 +1,73 @@
 #include "library_app.h"
 #include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
 
 
-int main() {
+// Usage: library_app [--catalog <compiled catalog>] [--policies <file>]
+//                    [--import-books <csv|jsonl>]... [--import-users <csv|jsonl>]...
+//                    [--script <commands file, or - for stdin>] [--virtual-time] [data_directory]
+int main(int argc, char* argv[]) {
 
     std::chrono::seconds day_duration(10); // 10 seconds represent a day
-    LibraryConsole<std::chrono::seconds> console(day_duration);
-    console.run();
-    return 0;
-}
+    ConsoleOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--catalog" && i + 1 < argc) {
+            options.catalog_path = argv[++i];
+        } else if (arg == "--import-books" && i + 1 < argc) {
+            options.book_imports.push_back(argv[++i]);
+        } else if (arg == "--import-users" && i + 1 < argc) {
+            options.user_imports.push_back(argv[++i]);
+        } else if (arg == "--script" && i + 1 < argc) {
+            options.script_path = argv[++i];
+        } else if (arg == "--virtual-time") {
+            options.virtual_time = true;
+        } else if (arg == "--policies" && i + 1 < argc) {
+            std::ifstream policies(argv[++i]);
+            if (!policies) {
+                std::cerr << "Cannot open policy file " << argv[i] << "\n";
+                return 1;
+            }
+            try {
+                load_user_policies(policies);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << argv[i] << ": " << e.what() << "\n";
+                return 1;
+            }
+        } else {
+            options.data_directory = arg;
+        }
+    }
+    std::optional<LibraryConsole<std::chrono::seconds>> console;
+    try {
+        console.emplace(day_duration, options);
+    } catch (const CatalogFormatException& e) {
+        std::cerr << e.what() << "\n"; // names the catalog and what is wrong with it
+        return 1;
+    } catch (const ImportException& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    } catch (const PersistenceException& e) {
+        std::cerr << "Cannot recover state from " << options.data_directory << ": " << e.what() << "\n";
+        return 1;
+    }
+    if (options.script_path.empty()) {
+        console->run();
+        return 0;
+    }
+    std::FILE* script = options.script_path == "-" ? stdin : std::fopen(options.script_path.c_str(), "rb");
+    if (!script) {
+        std::cerr << "Cannot open script " << options.script_path << "\n";
+        return 1;
+    }
+    size_t failed = console->run_script(script);
+    if (script != stdin) {
+        std::fclose(script);
+    }
+    return failed == 0 ? 0 : 3;
+}
\ No newline at end of file
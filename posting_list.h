@@ -0,0 +1,267 @@
+#pragma once
+#include "bits.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <vector>
+
+
+// Sorted set of non-negative ids for secondary indexes, laid out like a
+// roaring bitmap: ids are split by their high 16 bits into containers, and a
+// container stores the low 16 bits either as a sorted array (2 bytes per id)
+// or, once it holds more than kMaxArraySize ids, as a 65536-bit bitmap (at
+// most 8 KiB, however dense). A bitmap turns back into an array only below
+// kMinBitmapSize, so a container hovering around the limit is not converted
+// on every insert and erase. Inserting and erasing touch one container, and
+// iteration is in ascending id order.
+//
+// All memory comes from the list's memory resource; as an allocator-aware
+// type it inherits the resource of a std::pmr container it is placed in.
+class PostingList {
+public:
+    static constexpr size_t kMaxArraySize = 4096;
+    static constexpr size_t kMinBitmapSize = 3584;
+
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    PostingList() = default;
+    explicit PostingList(const allocator_type& allocator) : containers_(allocator) {}
+    PostingList(const PostingList& other, const allocator_type& allocator)
+        : containers_(other.containers_, allocator), size_(other.size_) {}
+    PostingList(PostingList&& other, const allocator_type& allocator)
+        : containers_(std::move(other.containers_), allocator), size_(other.size_) {}
+    PostingList(const PostingList&) = default;
+    PostingList(PostingList&&) = default;
+    PostingList& operator=(const PostingList&) = default;
+    PostingList& operator=(PostingList&&) = default;
+
+    allocator_type get_allocator() const { return containers_.get_allocator(); }
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = int;
+
+        const_iterator() = default;
+
+        int operator*() const { return value_; }
+
+        const_iterator& operator++() {
+            ++position_;
+            settle();
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return container_ == other.container_ && position_ == other.position_;
+        }
+
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class PostingList;
+
+        const_iterator(const PostingList* list, size_t container) : list_(list), container_(container) { settle(); }
+
+        // Moves to the first id at or after position_, across containers.
+        void settle() {
+            for (; container_ < list_->containers_.size(); ++container_, position_ = 0) {
+                const Container& container = list_->containers_[container_];
+                if (!container.is_bitmap()) {
+                    if (position_ < container.array.size()) {
+                        value_ = container.base() | container.array[position_];
+                        return;
+                    }
+                    continue;
+                }
+                // For bitmaps position_ is the next bit to look at.
+                for (size_t word = position_ / 64; word < container.bitmap.size(); ++word) {
+                    std::uint64_t bits = container.bitmap[word];
+                    if (word == position_ / 64) {
+                        bits &= ~std::uint64_t{0} << (position_ % 64);
+                    }
+                    if (bits != 0) {
+                        position_ = word * 64 + static_cast<size_t>(count_trailing_zeros(bits));
+                        value_ = container.base() | static_cast<int>(position_);
+                        return;
+                    }
+                }
+            }
+            position_ = 0;
+        }
+
+        const PostingList* list_ = nullptr;
+        size_t container_ = 0;
+        size_t position_ = 0;
+        int value_ = 0;
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, containers_.size()); }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    bool contains(int id) const {
+        auto it = find_container(high(id));
+        return it != containers_.end() && it->key == high(id) && it->contains(low(id));
+    }
+
+    // Returns false if the id was already there. Precondition: id >= 0.
+    bool insert(int id) {
+        auto it = find_container(high(id));
+        if (it == containers_.end() || it->key != high(id)) {
+            it = containers_.emplace(it, high(id));
+        }
+        if (!it->insert(low(id))) {
+            return false;
+        }
+        ++size_;
+        return true;
+    }
+
+    // Returns false if the id was not there.
+    bool erase(int id) {
+        auto it = find_container(high(id));
+        if (it == containers_.end() || it->key != high(id) || !it->erase(low(id))) {
+            return false;
+        }
+        if (it->cardinality == 0) {
+            containers_.erase(it);
+        }
+        --size_;
+        return true;
+    }
+
+    // Heap bytes held by the list (container headers and payloads).
+    size_t memory_bytes() const {
+        size_t bytes = containers_.capacity() * sizeof(Container);
+        for (const auto& container : containers_) {
+            bytes += container.array.capacity() * sizeof(std::uint16_t) + container.bitmap.capacity() * sizeof(std::uint64_t);
+        }
+        return bytes;
+    }
+
+private:
+    struct Container {
+        using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+        Container(std::uint16_t key, const allocator_type& allocator) : key(key), array(allocator), bitmap(allocator) {}
+        Container(const Container& other, const allocator_type& allocator)
+            : key(other.key), array(other.array, allocator), bitmap(other.bitmap, allocator), cardinality(other.cardinality) {}
+        Container(Container&& other, const allocator_type& allocator)
+            : key(other.key), array(std::move(other.array), allocator), bitmap(std::move(other.bitmap), allocator),
+              cardinality(other.cardinality) {}
+        Container(const Container&) = default;
+        Container(Container&&) = default;
+        Container& operator=(const Container&) = default;
+        Container& operator=(Container&&) = default;
+
+        std::uint16_t key; // high 16 bits of the ids
+        std::pmr::vector<std::uint16_t> array; // sorted low bits, unless a bitmap
+        std::pmr::vector<std::uint64_t> bitmap; // 1024 words once dense, else empty
+        std::uint32_t cardinality = 0;
+
+        bool is_bitmap() const { return !bitmap.empty(); }
+
+        int base() const { return static_cast<int>(key) << 16; }
+
+        bool contains(std::uint16_t value) const {
+            if (is_bitmap()) {
+                return (bitmap[value / 64] >> (value % 64)) & 1;
+            }
+            return std::binary_search(array.begin(), array.end(), value);
+        }
+
+        bool insert(std::uint16_t value) {
+            if (is_bitmap()) {
+                std::uint64_t& word = bitmap[value / 64];
+                std::uint64_t mask = std::uint64_t{1} << (value % 64);
+                if (word & mask) {
+                    return false;
+                }
+                word |= mask;
+            } else {
+                auto position = std::lower_bound(array.begin(), array.end(), value);
+                if (position != array.end() && *position == value) {
+                    return false;
+                }
+                array.insert(position, value);
+                if (array.size() > kMaxArraySize) {
+                    to_bitmap();
+                }
+            }
+            ++cardinality;
+            return true;
+        }
+
+        bool erase(std::uint16_t value) {
+            if (is_bitmap()) {
+                std::uint64_t& word = bitmap[value / 64];
+                std::uint64_t mask = std::uint64_t{1} << (value % 64);
+                if (!(word & mask)) {
+                    return false;
+                }
+                word &= ~mask;
+                if (--cardinality < kMinBitmapSize) {
+                    to_array();
+                }
+                return true;
+            }
+            auto position = std::lower_bound(array.begin(), array.end(), value);
+            if (position == array.end() || *position != value) {
+                return false;
+            }
+            array.erase(position);
+            --cardinality;
+            return true;
+        }
+
+        void to_bitmap() {
+            bitmap.assign(65536 / 64, 0);
+            for (std::uint16_t value : array) {
+                bitmap[value / 64] |= std::uint64_t{1} << (value % 64);
+            }
+            array.clear();
+            array.shrink_to_fit();
+        }
+
+        void to_array() {
+            array.reserve(cardinality);
+            for (size_t word = 0; word < bitmap.size(); ++word) {
+                for (std::uint64_t bits = bitmap[word]; bits != 0; bits &= bits - 1) {
+                    array.push_back(static_cast<std::uint16_t>(word * 64 + static_cast<size_t>(count_trailing_zeros(bits))));
+                }
+            }
+            bitmap.clear();
+            bitmap.shrink_to_fit();
+        }
+    };
+
+    static std::uint16_t high(int id) { return static_cast<std::uint16_t>(static_cast<std::uint32_t>(id) >> 16); }
+    static std::uint16_t low(int id) { return static_cast<std::uint16_t>(id & 0xffff); }
+
+    std::pmr::vector<Container>::iterator find_container(std::uint16_t key) {
+        return std::lower_bound(containers_.begin(), containers_.end(), key,
+                                [](const Container& container, std::uint16_t k) { return container.key < k; });
+    }
+
+    std::pmr::vector<Container>::const_iterator find_container(std::uint16_t key) const {
+        return std::lower_bound(containers_.begin(), containers_.end(), key,
+                                [](const Container& container, std::uint16_t k) { return container.key < k; });
+    }
+
+    std::pmr::vector<Container> containers_;
+    size_t size_ = 0;
+};
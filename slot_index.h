@@ -0,0 +1,82 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+
+// Maps ids to table slots. Ids up to a few times the number of entries are
+// looked up in a flat vector; ids far past that, as a sparse catalog or an
+// imported table may hand out, go to a hash map, so one huge id costs one map
+// entry rather than a vector that reaches it. When the table grows enough for
+// the vector to cover them, such ids move into it.
+class SlotIndex {
+public:
+    static constexpr std::uint32_t kNoSlot = std::numeric_limits<std::uint32_t>::max();
+
+    // kNoSlot if the id has no slot.
+    std::uint32_t find(int id) const {
+        if (id < 0) {
+            return kNoSlot;
+        }
+        if (static_cast<size_t>(id) < dense_.size()) {
+            return dense_[id];
+        }
+        if (sparse_.empty()) {
+            return kNoSlot;
+        }
+        auto it = sparse_.find(id);
+        return it == sparse_.end() ? kNoSlot : it->second;
+    }
+
+    // Precondition: id >= 0 and find(id) == kNoSlot.
+    void insert(int id, std::uint32_t slot) {
+        ++size_;
+        size_t index = static_cast<size_t>(id);
+        if (index >= dense_.size() && index < dense_limit()) {
+            grow(index);
+        }
+        if (index < dense_.size()) {
+            dense_[index] = slot;
+        } else {
+            sparse_.emplace(id, slot);
+        }
+    }
+
+    // Precondition: find(id) != kNoSlot.
+    void erase(int id) {
+        --size_;
+        if (static_cast<size_t>(id) < dense_.size()) {
+            dense_[id] = kNoSlot;
+        } else {
+            sparse_.erase(id);
+        }
+    }
+
+private:
+    static constexpr size_t kMinDense = 1024;
+
+    // Users and books draw ids from one generator, so a table's ids are spread
+    // over about twice its size; the rest of the slack absorbs removed rows.
+    size_t dense_limit() const { return std::max(kMinDense, size_ * 4); }
+
+    // Doubles the vector, or more to reach `index`, and moves the map's ids it
+    // now covers.
+    void grow(size_t index) {
+        size_t size = std::max(index + 1, std::min(dense_.size() * 2, dense_limit()));
+        dense_.resize(size, kNoSlot);
+        for (auto it = sparse_.begin(); it != sparse_.end();) {
+            if (static_cast<size_t>(it->first) < size) {
+                dense_[it->first] = it->second;
+                it = sparse_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::vector<std::uint32_t> dense_;
+    std::unordered_map<int, std::uint32_t> sparse_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,211 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+// Compact handle for an interned string. intern() and find() always return
+// the same symbol for the same text, so symbols they hand out compare equal
+// exactly when their strings do (symbols from add() are not deduplicated).
+enum class Symbol : std::uint32_t {};
+
+
+// Read-only string table owned by someone else (e.g. a memory-mapped catalog)
+// that a StringPool can serve symbols from without copying it.
+class StringSegment {
+public:
+    virtual ~StringSegment() = default;
+    virtual size_t string_count() const = 0;
+    virtual std::string_view string_at(std::uint32_t index) const = 0;
+    virtual std::optional<std::uint32_t> find_string(std::string_view text) const = 0;
+};
+
+
+// Append-only interning pool. Each distinct string is stored once, packed into
+// large character blocks, and is never freed or moved, so the views handed out
+// by str() stay valid for the lifetime of the pool.
+//
+// Attached segments extend the pool without copying: their strings get
+// symbols with the top bit set, and text found in a segment is not copied
+// into the pool. Attaching is O(1), which is what lets a mapped catalog open
+// in constant time. A text interned before a segment containing it was
+// attached keeps its pool symbol, so the segment's own symbol for it (as
+// returned by segment_symbol()) may differ; str() resolves both.
+//
+// The pool is safe to use from several threads. Lookups share a lock and
+// str() takes none: the symbol table grows in buckets that are never moved,
+// so a symbol received from another thread can always be resolved.
+class StringPool {
+public:
+    static constexpr size_t kMaxSegments = 8;
+    static constexpr std::uint32_t kMaxSegmentStrings = std::uint32_t{1} << 28;
+
+    StringPool() = default;
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    Symbol intern(std::string_view text) {
+        if (auto symbol = find(text)) {
+            return *symbol;
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (auto symbol = find_locked(text)) {
+            return *symbol;
+        }
+        Symbol symbol = append(text);
+        index_.emplace(str(symbol), symbol);
+        return symbol;
+    }
+
+    // Stores text without deduplicating it, for strings that are rarely shared
+    // (such as e-mail addresses), where the index would cost more than the
+    // text. The symbol resolves through str(), but find() and intern() never
+    // return it.
+    Symbol add(std::string_view text) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        return append(text);
+    }
+
+    std::optional<Symbol> find(std::string_view text) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return find_locked(text);
+    }
+
+    std::string_view str(Symbol symbol) const {
+        auto value = static_cast<std::uint32_t>(symbol);
+        if (value & kSegmentBit) {
+            return segments_[(value >> 28) & 0x7]->string_at(value & (kMaxSegmentStrings - 1));
+        }
+        auto [bucket, offset] = locate(value);
+        return buckets_[bucket][offset];
+    }
+
+    // Attaching the same segment twice returns the same id. The pool keeps the
+    // segment alive for its whole lifetime, since symbols may point into it.
+    std::uint32_t attach_segment(std::shared_ptr<const StringSegment> segment) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        for (std::uint32_t id = 0; id < segment_count_; ++id) {
+            if (segments_[id] == segment) {
+                return id;
+            }
+        }
+        if (segment_count_ == kMaxSegments) {
+            throw std::length_error("Too many string segments attached");
+        }
+        if (segment->string_count() > kMaxSegmentStrings) {
+            throw std::length_error("String segment is too large");
+        }
+        segments_[segment_count_] = std::move(segment);
+        return segment_count_++;
+    }
+
+    static Symbol segment_symbol(std::uint32_t segment, std::uint32_t index) {
+        return static_cast<Symbol>(kSegmentBit | (segment << 28) | index);
+    }
+
+    size_t size() const { return size_.load(std::memory_order_acquire); }
+
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+    static constexpr std::uint32_t kSegmentBit = std::uint32_t{1} << 31;
+    // Bucket k of the symbol table holds kFirstBucketSize << k entries.
+    static constexpr int kFirstBucketBits = 10;
+    static constexpr std::uint32_t kFirstBucketSize = std::uint32_t{1} << kFirstBucketBits;
+    static constexpr int kBucketCount = 32 - kFirstBucketBits;
+
+    static int highest_bit(std::uint32_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 31 - __builtin_clz(value);
+#else
+        int bit = 0;
+        while (value >>= 1) {
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    // (bucket, offset in bucket) of a pool symbol
+    static std::pair<int, std::uint32_t> locate(std::uint32_t value) {
+        std::uint32_t shifted = value + kFirstBucketSize;
+        int bit = highest_bit(shifted);
+        return {bit - kFirstBucketBits, shifted - (std::uint32_t{1} << bit)};
+    }
+
+    // Expects the exclusive lock.
+    Symbol append(std::string_view text) {
+        std::uint32_t value = size_.load(std::memory_order_relaxed);
+        if (value == kSegmentBit) {
+            throw std::length_error("String pool is full");
+        }
+        std::string_view stored = store(text);
+        auto [bucket, offset] = locate(value);
+        if (offset == 0) {
+            buckets_[bucket] = std::make_unique<std::string_view[]>(size_t{kFirstBucketSize} << bucket);
+        }
+        buckets_[bucket][offset] = stored;
+        size_.store(value + 1, std::memory_order_release);
+        return static_cast<Symbol>(value);
+    }
+
+    std::optional<Symbol> find_locked(std::string_view text) const {
+        auto it = index_.find(text);
+        if (it != index_.end()) {
+            return it->second;
+        }
+        for (std::uint32_t segment = 0; segment < segment_count_; ++segment) {
+            if (auto index = segments_[segment]->find_string(text)) {
+                return segment_symbol(segment, *index);
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::string_view store(std::string_view text) {
+        if (text.empty()) {
+            return {};
+        }
+        if (text.size() > kBlockSize / 4) {
+            // Long strings get a block of their own so they don't waste the tail of the current one.
+            blocks_.push_back(std::make_unique<char[]>(text.size()));
+            std::memcpy(blocks_.back().get(), text.data(), text.size());
+            return {blocks_.back().get(), text.size()};
+        }
+        if (current_block_ == nullptr || block_used_ + text.size() > kBlockSize) {
+            blocks_.push_back(std::make_unique<char[]>(kBlockSize));
+            current_block_ = blocks_.back().get();
+            block_used_ = 0;
+        }
+        char* dest = current_block_ + block_used_;
+        std::memcpy(dest, text.data(), text.size());
+        block_used_ += text.size();
+        return {dest, text.size()};
+    }
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* current_block_ = nullptr;
+    size_t block_used_ = 0;
+    std::array<std::unique_ptr<std::string_view[]>, kBucketCount> buckets_; // symbol -> text
+    std::atomic<std::uint32_t> size_{0};
+    std::unordered_map<std::string_view, Symbol> index_;
+    std::array<std::shared_ptr<const StringSegment>, kMaxSegments> segments_;
+    std::uint32_t segment_count_ = 0;
+    mutable std::shared_mutex mutex_; // guards index_, the blocks and new buckets and segments
+};
+
+
+// Process-wide pool shared by every Book and Library, so symbols can be
+// compared across libraries and Book values stay self-describing.
+inline StringPool& string_pool() {
+    static StringPool pool;
+    return pool;
+}
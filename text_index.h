@@ -0,0 +1,165 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+// visit(word) for each word of text, lower-cased. A word is a run of ASCII
+// letters and digits or of non-ASCII bytes, so UTF-8 words stay whole (they
+// are matched as written, only ASCII is case-folded).
+template <typename F>
+void for_each_word(std::string_view text, F&& visit) {
+    std::pmr::string word;
+    auto is_word_byte = [](unsigned char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+    };
+    for (size_t i = 0; i <= text.size(); ++i) {
+        if (i < text.size() && is_word_byte(static_cast<unsigned char>(text[i]))) {
+            char c = text[i];
+            word.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+        } else if (!word.empty()) {
+            visit(static_cast<const std::pmr::string&>(word));
+            word.clear();
+        }
+    }
+}
+
+
+// First position >= from in the sorted ids whose id is >= target: doubles the
+// step until it overshoots, then binary searches the last step. Costs
+// O(log gap), so a short list intersected with a long one skips most of the
+// long one.
+template <typename Ids>
+size_t gallop(const Ids& ids, size_t from, int target) {
+    size_t step = 1, low = from, high = from;
+    while (high < ids.size() && ids.begin()[high] < target) {
+        low = high + 1;
+        high += step;
+        step *= 2;
+    }
+    high = std::min(high, ids.size());
+    return static_cast<size_t>(std::lower_bound(ids.begin() + low, ids.begin() + high, target) - ids.begin());
+}
+
+
+// Word -> book ids inverted index for free-text search. Each posting list is a
+// sorted array of ids, so multi-word queries intersect them by walking the
+// shortest list and galloping through the others. Words are also kept in a
+// sorted set, where the words starting with a prefix form one contiguous
+// range (autocomplete); it only changes when a word appears or disappears.
+//
+// Not synchronized; Library updates it under its exclusive lock and searches
+// it under the shared one. All memory comes from the given resource.
+class TextIndex {
+public:
+    explicit TextIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : postings_(resource), words_(resource) {}
+
+    // Adds the words of text to the book's entries; adding a word twice is harmless.
+    void add(int book_id, std::string_view text) {
+        for_each_word(text, [&](const std::pmr::string& word) {
+            auto [it, inserted] = postings_.try_emplace(word);
+            if (inserted) {
+                words_.insert(it->first);
+            }
+            std::pmr::vector<int>& ids = it->second;
+            if (ids.empty() || ids.back() < book_id) {
+                ids.push_back(book_id);
+                return;
+            }
+            auto position = std::lower_bound(ids.begin(), ids.end(), book_id);
+            if (*position != book_id) {
+                ids.insert(position, book_id);
+            }
+        });
+    }
+
+    // Removes the book from the entries of every word of text, even if the
+    // word also came from another of the book's texts.
+    void remove(int book_id, std::string_view text) {
+        for_each_word(text, [&](const std::pmr::string& word) {
+            auto it = postings_.find(word);
+            if (it == postings_.end()) {
+                return;
+            }
+            std::pmr::vector<int>& ids = it->second;
+            auto position = std::lower_bound(ids.begin(), ids.end(), book_id);
+            if (position != ids.end() && *position == book_id) {
+                ids.erase(position);
+            }
+            if (ids.empty()) {
+                words_.erase(it->first);
+                postings_.erase(it);
+            }
+        });
+    }
+
+    // Ids of books whose texts contain every word of the query, ascending,
+    // stopping after `limit` ids. An empty query matches nothing.
+    std::vector<int> search(std::string_view query, size_t limit = std::numeric_limits<size_t>::max()) const {
+        std::vector<const std::pmr::vector<int>*> lists;
+        bool missing = false;
+        for_each_word(query, [&](const std::pmr::string& word) {
+            auto it = postings_.find(word);
+            if (it == postings_.end()) {
+                missing = true;
+            } else {
+                lists.push_back(&it->second);
+            }
+        });
+        std::vector<int> result;
+        if (missing || lists.empty()) {
+            return result;
+        }
+        std::sort(lists.begin(), lists.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+        lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+        std::vector<size_t> cursors(lists.size(), 0);
+        for (int candidate : *lists[0]) {
+            if (result.size() == limit) {
+                break;
+            }
+            bool in_all = true;
+            for (size_t i = 1; i < lists.size() && in_all; ++i) {
+                cursors[i] = gallop(*lists[i], cursors[i], candidate);
+                in_all = cursors[i] < lists[i]->size() && (*lists[i])[cursors[i]] == candidate;
+            }
+            if (in_all) {
+                result.push_back(candidate);
+            }
+        }
+        return result;
+    }
+
+    // Indexed words starting with the (case-folded) prefix, in byte order.
+    std::vector<std::string> complete(std::string_view prefix, size_t limit) const {
+        std::string folded;
+        for (char c : prefix) {
+            folded.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+        }
+        std::vector<std::string> result;
+        for (auto it = words_.lower_bound(folded);
+             it != words_.end() && result.size() < limit && it->substr(0, folded.size()) == folded; ++it) {
+            result.push_back(std::string(*it));
+        }
+        return result;
+    }
+
+    size_t word_count() const { return postings_.size(); }
+
+    void clear() {
+        words_.clear();
+        postings_.clear();
+    }
+
+private:
+    std::pmr::unordered_map<std::pmr::string, std::pmr::vector<int>> postings_;
+    std::pmr::set<std::string_view> words_; // keys of postings_, which never move
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+// Where a Clock reads the current time. A Clock without a source reads
+// std::chrono::system_clock directly; a source replaces that, e.g. to read
+// the time less often or to run a library on simulated time.
+class TimeSource {
+public:
+    virtual ~TimeSource() = default;
+    virtual std::chrono::system_clock::time_point now() const = 0;
+};
+
+
+// The wall clock, read on every call.
+class SystemTimeSource : public TimeSource {
+public:
+    std::chrono::system_clock::time_point now() const override {
+        return std::chrono::system_clock::now();
+    }
+};
+
+
+// The wall clock as of the last refresh(), so reading it is one atomic load
+// instead of a clock call. Refresh it once per batch or tick yourself, or
+// give an interval and a background thread refreshes it that often. Loans
+// are then stamped up to one interval early.
+class CoarseTimeSource : public TimeSource {
+public:
+    explicit CoarseTimeSource(std::chrono::milliseconds interval = std::chrono::milliseconds(0)) {
+        refresh();
+        if (interval.count() > 0) {
+            ticker_ = std::thread([this, interval] {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (!stopping_) {
+                    stopped_.wait_for(lock, interval);
+                    refresh();
+                }
+            });
+        }
+    }
+
+    CoarseTimeSource(const CoarseTimeSource&) = delete;
+    CoarseTimeSource& operator=(const CoarseTimeSource&) = delete;
+
+    ~CoarseTimeSource() override {
+        if (ticker_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            stopped_.notify_one();
+            ticker_.join();
+        }
+    }
+
+    std::chrono::system_clock::time_point now() const override {
+        return std::chrono::system_clock::time_point(std::chrono::system_clock::duration(ticks_.load(std::memory_order_relaxed)));
+    }
+
+    void refresh() {
+        ticks_.store(std::chrono::system_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::chrono::system_clock::rep> ticks_{0};
+    std::thread ticker_;
+    std::mutex mutex_;
+    std::condition_variable stopped_;
+    bool stopping_ = false;
+};
+
+
+// Simulated time that only moves when told to, for deterministic tests and
+// for replaying long loan histories without waiting: advancing it by a year
+// makes a year's loans overdue at once. Starts at the given time (the epoch
+// by default).
+class VirtualTimeSource : public TimeSource {
+public:
+    explicit VirtualTimeSource(std::chrono::system_clock::time_point start = {})
+        : ticks_(start.time_since_epoch().count()) {}
+
+    std::chrono::system_clock::time_point now() const override {
+        return std::chrono::system_clock::time_point(std::chrono::system_clock::duration(ticks_.load(std::memory_order_relaxed)));
+    }
+
+    void set(std::chrono::system_clock::time_point time) {
+        ticks_.store(time.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    template <typename Rep, typename Period>
+    void advance(std::chrono::duration<Rep, Period> by) {
+        ticks_.fetch_add(std::chrono::duration_cast<std::chrono::system_clock::duration>(by).count(), std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::chrono::system_clock::rep> ticks_;
+};
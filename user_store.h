@@ -0,0 +1,78 @@
+#pragma once
+#include "users.h"
+#include "slot_index.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+
+// Users stored by value in one table, indexed by id the same way BookStore is:
+// ids map to slots through a SlotIndex, and slots of removed users are
+// reused. Slots live in a deque, so a user never moves while it exists and a
+// reference to it stays valid until that user is removed.
+//
+// Inserting and erasing need exclusive access; a user's own fields are
+// guarded by whoever owns the row (Library's user shards).
+class UserStore {
+public:
+    bool contains(int user_id) const {
+        return slot_of(user_id) != kNoSlot;
+    }
+
+    size_t size() const { return users_.size() - free_slots_.size(); }
+
+    // Precondition: user.get_id() >= 0 and !contains(user.get_id()).
+    User& insert(const User& user) {
+        int user_id = user.get_id();
+        std::uint32_t slot;
+        if (!free_slots_.empty()) {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+            users_[slot] = user;
+        } else {
+            slot = static_cast<std::uint32_t>(users_.size());
+            users_.push_back(user);
+            occupied_.push_back(false);
+        }
+        slots_.insert(user_id, slot);
+        occupied_[slot] = true;
+        return users_[slot];
+    }
+
+    // Precondition: contains(user_id).
+    void erase(int user_id) {
+        std::uint32_t slot = slots_.find(user_id);
+        slots_.erase(user_id);
+        occupied_[slot] = false;
+        free_slots_.push_back(slot);
+    }
+
+    User* find(int user_id) {
+        std::uint32_t slot = slot_of(user_id);
+        return slot == kNoSlot ? nullptr : &users_[slot];
+    }
+
+    const User* find(int user_id) const {
+        std::uint32_t slot = slot_of(user_id);
+        return slot == kNoSlot ? nullptr : &users_[slot];
+    }
+
+    template <typename F>
+    void for_each(F&& visit) const {
+        for (size_t slot = 0; slot < users_.size(); ++slot) {
+            if (occupied_[slot]) {
+                visit(users_[slot]);
+            }
+        }
+    }
+
+private:
+    static constexpr std::uint32_t kNoSlot = SlotIndex::kNoSlot;
+
+    std::uint32_t slot_of(int user_id) const { return slots_.find(user_id); }
+
+    SlotIndex slots_;
+    std::vector<std::uint32_t> free_slots_;
+    std::deque<User> users_; // by slot
+    std::vector<bool> occupied_; // by slot
+};
@@ -1,8 +1,14 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include "book.h"
-#include <unordered_map>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
 
 // enum MAX_BORROW_BOOK {
@@ -18,41 +24,148 @@ enum class UserType {
     GUEST
 };
 
-const std::unordered_map<UserType, int> user_type_to_borrow_limit = {
-    {UserType::STUDENT, 5},
-    {UserType::FACULTY, 10},
-    {UserType::GUEST, 2}
-};
+constexpr size_t kUserTypeCount = 3;
 
 
-const std::unordered_map<UserType, int> user_type_to_max_borrowed_days = {
-    {UserType::STUDENT, 3},
-    {UserType::FACULTY, 10},
-    {UserType::GUEST, 1}
+struct UserPolicy {
+    int borrow_limit;
+    int max_borrowed_days;
+    int fine_per_day;
+    int hold_priority; // holds of lower levels are served first, 0 .. kUserTypeCount - 1
+    int hold_days; // how long a hold waits for its book before it expires
 };
 
-const std::unordered_map<UserType, int> user_type_to_fine = {
-    {UserType::STUDENT, 10},
-    {UserType::FACULTY, 5},
-    {UserType::GUEST, 20}
+using UserPolicyTable = std::array<UserPolicy, kUserTypeCount>;
+
+// Indexed by UserType.
+constexpr UserPolicyTable kDefaultUserPolicies = {{
+    {5, 3, 10, 1, 14}, // STUDENT
+    {10, 10, 5, 0, 30}, // FACULTY
+    {2, 1, 20, 2, 7}    // GUEST
+}};
+
+// Policies in effect. A deployment may replace them at startup, before any
+// Library is used; lookups are a plain array index.
+inline UserPolicyTable user_policies = kDefaultUserPolicies;
+
+inline const UserPolicy& policy_of(UserType type) {
+    return user_policies[static_cast<size_t>(type)];
+}
+
+// "student", "faculty" or "guest", as in policy files and import files.
+inline std::optional<UserType> user_type_from_name(std::string_view name) {
+    if (name == "student") return UserType::STUDENT;
+    if (name == "faculty") return UserType::FACULTY;
+    if (name == "guest") return UserType::GUEST;
+    return std::nullopt;
+}
+
+// Reads lines of the form "<student|faculty|guest> <borrow_limit>
+// <max_borrowed_days> <fine_per_day> [<hold_priority> [<hold_days>]]"; blank
+// lines and lines starting with '#' are skipped. Types that are not listed
+// keep their current policy.
+inline void load_user_policies(std::istream& in) {
+    UserPolicyTable table = user_policies;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string type;
+        if (!(fields >> type) || type[0] == '#') {
+            continue;
+        }
+        std::optional<UserType> user_type = user_type_from_name(type);
+        if (!user_type) {
+            throw std::invalid_argument("Unknown user type in policy: " + type);
+        }
+        UserPolicy policy = table[static_cast<size_t>(*user_type)];
+        bool valid = static_cast<bool>(fields >> policy.borrow_limit >> policy.max_borrowed_days >> policy.fine_per_day);
+        // The hold columns are optional; one left out keeps its current value.
+        if (valid && !(fields >> policy.hold_priority >> policy.hold_days)) {
+            valid = fields.eof();
+        }
+        std::string extra;
+        if (valid && fields >> extra) {
+            valid = false; // text after the last column
+        }
+        if (!valid || policy.borrow_limit < 0 || policy.max_borrowed_days < 0 || policy.fine_per_day < 0
+            || policy.hold_priority < 0 || policy.hold_priority >= static_cast<int>(kUserTypeCount) || policy.hold_days < 0) {
+            throw std::invalid_argument("Invalid user policy line: " + line);
+        }
+        table[static_cast<size_t>(*user_type)] = policy;
+    }
+    user_policies = table;
+}
+
+// Ids of the books a user has out. Borrow limits are small, so the ids live
+// inline in the user and are found by a linear scan; a list that outgrows
+// kInlineCapacity moves to the heap once and stays there.
+class LoanList {
+public:
+    static constexpr size_t kInlineCapacity = 10;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const int* begin() const { return data(); }
+    const int* end() const { return data() + size_; }
+
+    bool contains(int book_id) const {
+        return std::find(begin(), end(), book_id) != end();
+    }
+
+    void add(int book_id) {
+        if (size_ == kInlineCapacity && spilled_.empty()) {
+            spilled_.assign(inline_ids_.begin(), inline_ids_.end());
+        }
+        if (!spilled_.empty()) {
+            spilled_.resize(size_ + 1);
+        }
+        data()[size_++] = book_id;
+    }
+
+    // Order is not kept: the last id takes the place of the removed one.
+    bool remove(int book_id) {
+        int* ids = data();
+        int* it = std::find(ids, ids + size_, book_id);
+        if (it == ids + size_) {
+            return false;
+        }
+        *it = ids[--size_];
+        return true;
+    }
+
+private:
+    int* data() { return spilled_.empty() ? inline_ids_.data() : spilled_.data(); }
+    const int* data() const { return spilled_.empty() ? inline_ids_.data() : spilled_.data(); }
+
+    std::array<int, kInlineCapacity> inline_ids_{};
+    std::vector<int> spilled_; // holds all ids once the inline array is full
+    size_t size_ = 0;
 };
 
+
+// A plain value type: the type is a field, so policy lookups need no virtual
+// call, and name and email live in string_pool() like a Book's strings, so
+// copying a user never touches the heap unless its loan list has spilled.
+// Names repeat often and are interned; e-mails are nearly always unique and
+// are stored without an index entry.
 class User {
 public:
-    User(std::string name, std::string email, int id): name_(name), email_(email), id_(id), borrowed_books_() {};
+    User(UserType type, std::string_view name, std::string_view email, int id)
+        : name_(string_pool().intern(name)), email_(string_pool().add(email)), id_(id), type_(type), loans_() {};
 
 
 
     int max_borrow_limit() const {
-        return user_type_to_borrow_limit.at(get_user_type());
+        return policy_of(type_).borrow_limit;
     };
 
     int max_borrowed_days() const {
-        return user_type_to_max_borrowed_days.at(get_user_type());
+        return policy_of(type_).max_borrowed_days;
     };
 
     int get_penalty_for_one_day() const {
-        return user_type_to_fine.at(get_user_type());
+        return policy_of(type_).fine_per_day;
     }
 
     int get_penalty_value() const {
@@ -66,68 +179,73 @@ public:
         penalty_ += amount;
     }
 
-    std::vector<Book> get_borrowed_books() const {
-        return borrowed_books_;
-    }
+    const LoanList& get_loans() const { return loans_; }
+
+    size_t borrowed_count() const { return loans_.size(); }
 
-    std::string get_name() const { return this->name_; }
+    std::string_view get_name() const { return string_pool().str(name_); }
 
-    std::string get_email() const { return this->email_; }
+    std::string_view get_email() const { return string_pool().str(email_); }
 
     int get_id() const { return this->id_; }
 
-    bool can_borrow() {
-        return borrowed_books_.size() < max_borrow_limit();
+    bool can_borrow() const {
+        return loans_.size() < static_cast<size_t>(max_borrow_limit());
     };
 
-    void borrow_book(Book& book) {
+    void borrow_book(int book_id) {
         if (!can_borrow()) {throw std::logic_error("Borrow limit exceeded");}
-        if (!book.is_available()) {throw std::logic_error("Book is not available");}
-        book.take();
-        borrowed_books_.push_back(book);
+        loans_.add(book_id);
     };
 
+    void return_book(int book_id) {
+        if (!loans_.remove(book_id)) {throw std::logic_error("Book is not borrowed by this user");}
+    }
 
 
 
-    virtual UserType get_user_type() const = 0;
 
-    virtual ~User() = default;
+    UserType get_user_type() const { return type_; }
 
 private:
-    std::string name_, email_;
+    Symbol name_, email_;
     int id_, penalty_ = 0;
-    std::vector<Book> borrowed_books_;
+    UserType type_;
+    LoanList loans_;
 };
 
 
+// Shorthands for building a user of a given type. They add no state, so
+// they can be stored and copied as plain Users.
 class Student: public User {
 public:
-    using User::User;
-    UserType get_user_type() const override{
-        return UserType::STUDENT;
-    }
-    
+    Student(std::string_view name, std::string_view email, int id)
+        : User(UserType::STUDENT, name, email, id) {}
 };
 
 
 
 class Faculty: public User {
 public:
-    using User::User;
-
-    UserType get_user_type() const override {
-        return UserType::FACULTY;
-    }
-    
+    Faculty(std::string_view name, std::string_view email, int id)
+        : User(UserType::FACULTY, name, email, id) {}
 };
 
 
 class Guest: public User {
 public:
-    using User::User;
+    Guest(std::string_view name, std::string_view email, int id)
+        : User(UserType::GUEST, name, email, id) {}
+};
+
 
-    UserType get_user_type() const override {
-        return UserType::GUEST;
+// For types read from outside (logs, snapshots), which may be out of range.
+inline User make_user(UserType type, std::string_view name, std::string_view email, int id) {
+    switch (type) {
+    case UserType::STUDENT:
+    case UserType::FACULTY:
+    case UserType::GUEST:
+        return User(type, name, email, id);
     }
-};
\ No newline at end of file
+    throw std::invalid_argument("Unknown user type");
+}
\ No newline at end of file
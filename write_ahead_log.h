@@ -0,0 +1,492 @@
+#pragma once
+#include "users.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+
+class PersistenceException : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+
+// Little helpers for the compact on-disk encoding shared by the log and the
+// snapshots: LEB128 varints, zigzag for signed values, length-prefixed strings.
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::string& out) : out_(out) {}
+
+    void u8(std::uint8_t value) { out_.push_back(static_cast<char>(value)); }
+
+    void varint(std::uint64_t value) {
+        while (value >= 0x80) {
+            out_.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out_.push_back(static_cast<char>(value));
+    }
+
+    void svarint(std::int64_t value) {
+        varint((static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+    }
+
+    void fixed32(std::uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out_.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+
+    void fixed64(std::uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            out_.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+
+    void str(std::string_view value) {
+        varint(value.size());
+        out_.append(value.data(), value.size());
+    }
+
+    void time(std::chrono::system_clock::time_point value) {
+        svarint(std::chrono::duration_cast<std::chrono::microseconds>(value.time_since_epoch()).count());
+    }
+
+private:
+    std::string& out_;
+};
+
+
+class BinaryReader {
+public:
+    explicit BinaryReader(std::string_view in) : in_(in) {}
+
+    bool at_end() const { return pos_ == in_.size(); }
+
+    size_t position() const { return pos_; }
+
+    std::uint8_t u8() {
+        require(1);
+        return static_cast<std::uint8_t>(in_[pos_++]);
+    }
+
+    std::uint64_t varint() {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t byte = u8();
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw PersistenceException("Malformed varint");
+    }
+
+    std::int64_t svarint() {
+        std::uint64_t value = varint();
+        return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+    }
+
+    std::uint32_t fixed32() {
+        require(4);
+        std::uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(in_[pos_++])) << (8 * i);
+        }
+        return value;
+    }
+
+    std::uint64_t fixed64() {
+        require(8);
+        std::uint64_t value = 0;
+        for (int i = 0; i < 8; ++i) {
+            value |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(in_[pos_++])) << (8 * i);
+        }
+        return value;
+    }
+
+    std::string_view str() {
+        std::uint64_t size = varint();
+        require(size);
+        std::string_view value = in_.substr(pos_, size);
+        pos_ += size;
+        return value;
+    }
+
+    std::chrono::system_clock::time_point time() {
+        auto since_epoch = std::chrono::microseconds(svarint());
+        return std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(since_epoch));
+    }
+
+private:
+    void require(std::uint64_t size) const {
+        if (size > in_.size() - pos_) {
+            throw PersistenceException("Unexpected end of data");
+        }
+    }
+
+    std::string_view in_;
+    size_t pos_ = 0;
+};
+
+
+// FNV-1a; only used to detect torn or corrupted records, not tampering.
+inline std::uint32_t checksum32(std::string_view data) {
+    std::uint32_t hash = 2166136261u;
+    for (char c : data) {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+inline void sync_file(std::FILE* file) {
+    if (std::fflush(file) != 0) {
+        throw PersistenceException("Failed to flush file");
+    }
+#ifdef _WIN32
+    if (_commit(_fileno(file)) != 0) {
+#else
+    if (fsync(fileno(file)) != 0) {
+#endif
+        throw PersistenceException("Failed to sync file");
+    }
+}
+
+
+enum class WalRecordType : std::uint8_t {
+    ADD_USER = 1,
+    ADD_BOOK,
+    REMOVE_USER,
+    REMOVE_BOOK,
+    BORROW,
+    RETURN,
+    ADD_PENALTY
+};
+
+
+// Decoded form of a log record, used only during replay. Which fields are
+// meaningful depends on the type.
+struct WalRecord {
+    WalRecordType type;
+    int user_id = 0;
+    int book_id = 0;
+    int amount = 0; // penalty charged (RETURN, ADD_PENALTY)
+    UserType user_type = UserType::STUDENT;
+    std::chrono::system_clock::time_point time{}; // taken time (BORROW), return time (RETURN)
+    std::string_view name, email, author, genre; // point into the reader's buffer
+};
+
+
+struct WalOptions {
+    // A batch is written and fsynced once it reaches this size...
+    size_t group_commit_bytes = 64 * 1024;
+    // ...or once its oldest record has waited this long, whichever comes first.
+    std::chrono::milliseconds group_commit_interval{50};
+};
+
+
+// Append-only operation log with group commit. Records are encoded into an
+// in-memory batch; a batch is written and fsynced as a whole, so a burst of
+// operations costs one fsync. A record is durable once sync() returns or the
+// group commit interval has passed.
+//
+// File layout: 8-byte magic, fixed64 base LSN, then frames of
+// varint(payload size) | payload | fixed32(checksum32(payload)).
+// The n-th frame (from 0) carries log sequence number base LSN + n.
+class WriteAheadLog {
+public:
+    static constexpr std::string_view kMagic = "LIBWAL01";
+
+    static void create(const std::string& path, std::uint64_t base_lsn) {
+        std::string header(kMagic);
+        BinaryWriter(header).fixed64(base_lsn);
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            throw PersistenceException("Cannot create log " + path);
+        }
+        bool written = std::fwrite(header.data(), 1, header.size(), file) == header.size()
+            && std::fflush(file) == 0;
+        std::fclose(file);
+        if (!written) {
+            throw PersistenceException("Cannot write log header " + path);
+        }
+    }
+
+    // Opens an existing, already validated log for appending; next_lsn is the
+    // LSN the next appended record gets.
+    WriteAheadLog(const std::string& path, std::uint64_t next_lsn, WalOptions options = {})
+        : options_(options), next_lsn_(next_lsn) {
+        file_ = std::fopen(path.c_str(), "ab");
+        if (file_ == nullptr) {
+            throw PersistenceException("Cannot open log " + path);
+        }
+        flusher_ = std::thread([this] { flush_loop(); });
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    ~WriteAheadLog() {
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex_);
+            stopping_ = true;
+        }
+        batch_ready_.notify_one();
+        flusher_.join();
+        try {
+            sync();
+        } catch (const PersistenceException&) {
+        }
+        std::fclose(file_);
+    }
+
+    void log_add_user(const User& user) {
+        append(WalRecordType::ADD_USER, [&](BinaryWriter& out) {
+            out.svarint(user.get_id());
+            out.u8(static_cast<std::uint8_t>(user.get_user_type()));
+            out.str(user.get_name());
+            out.str(user.get_email());
+        });
+    }
+
+    void log_add_book(int book_id, std::string_view name, std::string_view author, std::string_view genre) {
+        append(WalRecordType::ADD_BOOK, [&](BinaryWriter& out) {
+            out.svarint(book_id);
+            out.str(name);
+            out.str(author);
+            out.str(genre);
+        });
+    }
+
+    void log_remove_user(int user_id) {
+        append(WalRecordType::REMOVE_USER, [&](BinaryWriter& out) { out.svarint(user_id); });
+    }
+
+    void log_remove_book(int book_id) {
+        append(WalRecordType::REMOVE_BOOK, [&](BinaryWriter& out) { out.svarint(book_id); });
+    }
+
+    void log_borrow(int user_id, int book_id, std::chrono::system_clock::time_point taken_time) {
+        append(WalRecordType::BORROW, [&](BinaryWriter& out) {
+            out.svarint(user_id);
+            out.svarint(book_id);
+            out.time(taken_time);
+        });
+    }
+
+    void log_return(int book_id, int penalty, std::chrono::system_clock::time_point returned_time) {
+        append(WalRecordType::RETURN, [&](BinaryWriter& out) {
+            out.svarint(book_id);
+            out.svarint(penalty);
+            out.time(returned_time);
+        });
+    }
+
+    void log_add_penalty(int user_id, int amount) {
+        append(WalRecordType::ADD_PENALTY, [&](BinaryWriter& out) {
+            out.svarint(user_id);
+            out.svarint(amount);
+        });
+    }
+
+    // Writes and fsyncs everything appended so far.
+    void sync() {
+        std::lock_guard<std::mutex> io_lock(io_mutex_);
+        std::string batch;
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex_);
+            batch.swap(batch_);
+        }
+        if (batch.empty()) {
+            return;
+        }
+        if (std::fwrite(batch.data(), 1, batch.size(), file_) != batch.size()) {
+            throw PersistenceException("Failed to write log");
+        }
+        sync_file(file_);
+    }
+
+    std::uint64_t next_lsn() const {
+        std::lock_guard<std::mutex> lock(batch_mutex_);
+        return next_lsn_;
+    }
+
+private:
+    template <typename Encode>
+    void append(WalRecordType type, Encode&& encode) {
+        thread_local std::string payload_scratch;
+        payload_scratch.clear();
+        BinaryWriter payload(payload_scratch);
+        payload.u8(static_cast<std::uint8_t>(type));
+        encode(payload);
+
+        bool batch_full;
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex_);
+            if (batch_.empty()) {
+                batch_started_ = std::chrono::steady_clock::now();
+                batch_ready_.notify_one();
+            }
+            BinaryWriter frame(batch_);
+            frame.varint(payload_scratch.size());
+            batch_.append(payload_scratch);
+            frame.fixed32(checksum32(payload_scratch));
+            ++next_lsn_;
+            batch_full = batch_.size() >= options_.group_commit_bytes;
+        }
+        if (batch_full) {
+            sync();
+        }
+    }
+
+    // Background group commit: flushes a non-empty batch once it is
+    // group_commit_interval old, so idle periods don't leave records unsynced.
+    void flush_loop() {
+        std::unique_lock<std::mutex> lock(batch_mutex_);
+        while (!stopping_) {
+            if (batch_.empty()) {
+                batch_ready_.wait(lock);
+                continue;
+            }
+            auto deadline = batch_started_ + options_.group_commit_interval;
+            if (batch_ready_.wait_until(lock, deadline) == std::cv_status::timeout && !batch_.empty()) {
+                lock.unlock();
+                try {
+                    sync();
+                } catch (const PersistenceException&) {
+                    // The next explicit sync() reports the failure.
+                }
+                lock.lock();
+            }
+        }
+    }
+
+    WalOptions options_;
+    std::FILE* file_ = nullptr;
+    std::mutex io_mutex_; // serializes writes to file_; taken before batch_mutex_
+    mutable std::mutex batch_mutex_;
+    std::condition_variable batch_ready_;
+    std::string batch_;
+    std::chrono::steady_clock::time_point batch_started_;
+    std::uint64_t next_lsn_;
+    bool stopping_ = false;
+    std::thread flusher_;
+};
+
+
+// Reads a log written by WriteAheadLog. Iteration stops at the first torn or
+// corrupted frame; valid_size() then tells how much of the file can be kept.
+class WalReader {
+public:
+    explicit WalReader(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw PersistenceException("Cannot open log " + path);
+        }
+        data_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (data_.size() < WriteAheadLog::kMagic.size() + 8
+            || std::string_view(data_).substr(0, WriteAheadLog::kMagic.size()) != WriteAheadLog::kMagic) {
+            throw PersistenceException("Not a library log: " + path);
+        }
+        BinaryReader header(std::string_view(data_).substr(WriteAheadLog::kMagic.size(), 8));
+        base_lsn_ = header.fixed64();
+        valid_size_ = WriteAheadLog::kMagic.size() + 8;
+        next_lsn_ = base_lsn_;
+    }
+
+    std::uint64_t base_lsn() const { return base_lsn_; }
+
+    // LSN of the record the next call to next() returns.
+    std::uint64_t next_lsn() const { return next_lsn_; }
+
+    size_t valid_size() const { return valid_size_; }
+
+    bool next(WalRecord& record) {
+        std::string_view rest = std::string_view(data_).substr(valid_size_);
+        if (rest.empty()) {
+            return false;
+        }
+        try {
+            BinaryReader frame(rest);
+            std::uint64_t size = frame.varint();
+            size_t header_size = frame.position();
+            if (size > rest.size() - header_size || rest.size() - header_size - size < 4) {
+                return false;
+            }
+            std::string_view payload = rest.substr(header_size, size);
+            BinaryReader trailer(rest.substr(header_size + size, 4));
+            if (trailer.fixed32() != checksum32(payload)) {
+                return false;
+            }
+            decode(payload, record);
+            valid_size_ += header_size + size + 4;
+            ++next_lsn_;
+            return true;
+        } catch (const PersistenceException&) {
+            return false;
+        }
+    }
+
+private:
+    static void decode(std::string_view payload, WalRecord& record) {
+        BinaryReader in(payload);
+        record = WalRecord{};
+        record.type = static_cast<WalRecordType>(in.u8());
+        switch (record.type) {
+        case WalRecordType::ADD_USER:
+            record.user_id = static_cast<int>(in.svarint());
+            record.user_type = static_cast<UserType>(in.u8());
+            record.name = in.str();
+            record.email = in.str();
+            break;
+        case WalRecordType::ADD_BOOK:
+            record.book_id = static_cast<int>(in.svarint());
+            record.name = in.str();
+            record.author = in.str();
+            record.genre = in.str();
+            break;
+        case WalRecordType::REMOVE_USER:
+            record.user_id = static_cast<int>(in.svarint());
+            break;
+        case WalRecordType::REMOVE_BOOK:
+            record.book_id = static_cast<int>(in.svarint());
+            break;
+        case WalRecordType::BORROW:
+            record.user_id = static_cast<int>(in.svarint());
+            record.book_id = static_cast<int>(in.svarint());
+            record.time = in.time();
+            break;
+        case WalRecordType::RETURN:
+            record.book_id = static_cast<int>(in.svarint());
+            record.amount = static_cast<int>(in.svarint());
+            record.time = in.time();
+            break;
+        case WalRecordType::ADD_PENALTY:
+            record.user_id = static_cast<int>(in.svarint());
+            record.amount = static_cast<int>(in.svarint());
+            break;
+        default:
+            throw PersistenceException("Unknown log record type");
+        }
+    }
+
+    std::string data_;
+    std::uint64_t base_lsn_ = 0;
+    std::uint64_t next_lsn_ = 0;
+    size_t valid_size_ = 0;
+};